@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+/// Counts a hardware event, such as cache misses, for the calling thread and any
+/// threads that it starts while the counter is running. Counting is only available
+/// on Linux and where the system's perf_event_paranoid setting allows it.
+class EventCounter
+{
+	public :
+
+		enum
+		{
+			kCacheReferences,
+			kCacheMisses
+		};
+
+		EventCounter( int event );
+		~EventCounter();
+
+		inline bool valid() const { return m_fd >= 0; }
+		void start();
+		/// Returns the number of events since start() or -1 if the counter isn't valid.
+		long long stop();
+
+	private :
+
+		int m_fd;
+};
+
+/// Filters the images without tiles and then with each tile order and prints the time
+/// and cache behaviour of each run. Returns the exit code for main().
+int benchmark( const std::vector< const Image* > &frames, const Options &opt );
+
+/// Times the filter on sequences made by the generator in Sequence.h as the number of threads
+/// grows to filterThreads( opt ), the resolution to that of generatorScene( opt ) and the number
+/// of images to opt.nImages, and prints the throughput of each run. Returns the exit code for main().
+int scaling( const Options &opt );
+
+#endif
@@ -0,0 +1,133 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+#ifndef _FILTER_H_
+#define _FILTER_H_
+
+#include <chrono>
+#include <functional>
+#include <memory>
+
+/// Returns the Gaussian weight for a point 'x' in a normal distribution
+/// centered at the mean with the given deviation.
+double gaussian( double x, double mean, double deviation, bool normalize = true );
+
+/// A step function which has a falloff that starts when the value 'x'
+/// gets within 10% of a limit. The returned value will never reach 0
+/// if it is within range. Values of 'x' that are out of the range 
+/// are set to 0.
+double softStep( double x, double min, double max );
+
+/// The terms of the filter's weights which only depend on the source pixel's own
+/// samples: the likelihood of each sample given the pixel's distribution and the
+/// soft limit weight of each sample. They are evaluated once per sample of each
+/// guide channel instead of once for every destination pixel whose kernel covers
+/// the source, and as they don't depend on any of the filter's options they can be
+/// reused when the same guide is filtered more than once.
+struct SourceTerms
+{
+	public :
+
+		SourceTerms( const SampleSet &guide );
+		/// Recomputes the terms of the pixels whose entry ( y * width + x ) in changed is non-zero
+		/// after the guide has been updated.
+		void update( const SampleSet &guide, const std::vector< unsigned char > &changed );
+
+		inline const double *likelihood( int x, int y, int c ) const { return &m_likelihood[ arrayIndex( x, y, c ) ]; }
+		inline const double *limitWeight( int x, int y, int c ) const { return &m_limitWeight[ arrayIndex( x, y, c ) ]; }
+
+	private :
+
+		void computePixel( const SampleSet &guide, int x, int y, std::vector< double > &scratch );
+
+		inline int arrayIndex( int x, int y, int c ) const
+		{
+			x = std::max( std::min( x, m_width - 1 ), 0 );
+			y = std::max( std::min( y, m_height - 1 ), 0 );
+			return ( ( y * m_width + x ) * m_channels + c ) * m_samples;
+		}
+
+		int m_width, m_height, m_channels, m_samples;
+		std::vector< double > m_likelihood, m_limitWeight;
+};
+
+/// Builds the single channel image that the weights are computed from when
+/// opt.weightMode shares one set of weights between the three channels.
+void weightGuide( const Image &image, const Options &opt, Image &guide );
+
+/// Returns the size of the tiles that the filter splits the set into. Unless opt.tileSize
+/// sets it, this is the largest size for which the sample data of a tile and its kernel
+/// halo fits comfortably in the L2 cache.
+int filterTileSize( const SampleSet &guide, const SampleSet &set, const Options &opt );
+
+/// Fills tiles with the indices ( y * tilesX + x ) of the tiles in the order given by
+/// one of Options::kRaster, kZOrder or kHilbert.
+void tileOrder( int tilesX, int tilesY, int order, std::vector< int > &tiles );
+
+/// Returns the number of threads that the filter will use for the options.
+int filterThreads( const Options &opt );
+
+/// Runs the spatial filter over the sample set and writes the filtered
+/// values into result, which is resized to match the set. The image is
+/// split into tiles which are shared between opt.threads threads.
+void filter( const SampleSet &set, const Options &opt, Image &result, bool showProgress = true );
+/// Filters the set using weights computed from the guide rather than from the set itself.
+/// The guide must have the same size and number of samples as the set and either three
+/// channels, which guide the matching channel of every layer, or one which guides them all.
+void filter( const SampleSet &guide, const SampleSet &set, const Options &opt, Image &result, bool showProgress = true );
+/// Filters the set using terms that have already been computed for the guide.
+void filter( const SampleSet &guide, const SourceTerms &terms, const SampleSet &set, const Options &opt, Image &result, bool showProgress = true );
+
+/// Restricts a run of the filter to part of the image or to a point in time.
+struct FilterControl
+{
+	FilterControl() : mask( 0 ), deadline( std::chrono::steady_clock::time_point::max() ), showProgress( true ) {}
+
+	/// When set, only the pixels whose entry ( y * width + x ) is non-zero are filtered
+	/// and the rest of the result is left as it was, so it must already have the set's size.
+	const std::vector< unsigned char > *mask;
+	/// The tiles that haven't been started when the deadline passes are skipped.
+	std::chrono::steady_clock::time_point deadline;
+	/// When set, it is called from the filter's threads with the bounds [x0, x1) x [y0, y1)
+	/// of each tile once the tile's pixels are in the result, unless the mask skipped them all.
+	std::function< void ( int x0, int y0, int x1, int y1 ) > tileDone;
+	bool showProgress;
+};
+
+/// Filters the set as above under the given control and returns false if the
+/// deadline passed before all of the tiles were filtered.
+bool filter( const SampleSet &guide, const SourceTerms &terms, const SampleSet &set, const Options &opt, Image &result, const FilterControl &control );
+
+/// Builds the sample set of the guide images that opt.weightMode asks for, or returns
+/// null when the weights are computed per channel from the images themselves.
+std::unique_ptr< SampleSet > weightGuideSet( const std::vector< const Image* > &images, const Options &opt );
+
+/// Builds the sample set for the images, and the guide that opt.weightMode asks for, and filters it,
+/// or filters their luma and chroma separately when opt.chromaScale is set.
+void denoise( const std::vector< const Image* > &images, const Options &opt, Image &result, bool showProgress = true );
+
+#endif
@@ -44,33 +44,43 @@ inline double toGamma22(int x)
 	return pow( ( ( double( x ) ) / 255 ), 2.2 );
 }
 
+/// Returns a table of toGamma22() for each of the 256 byte values.
+const double *gamma22Table();
+
 struct Image
 {
 	public :
 	
-		Image( int w = 1, int h = 1 );
+		Image( int w = 1, int h = 1, int channels = 3 );
 
 		const double* readable( int x, int y ) const;
 		double* writeable( int x, int y );
 		const double* at( int x, int y ) const;
 		inline int width() const { return m_width; };
 		inline int height() const { return m_height; };
+		inline int channels() const { return m_channels; };
 		
 		inline void resize( int width, int height )
 		{
-			if( width < 1 || height < 1 )
+			resize( width, height, m_channels );
+		}
+
+		inline void resize( int width, int height, int channels )
+		{
+			if( width < 1 || height < 1 || channels < 1 )
 			{
 				throw std::runtime_error( "Cannot resize an image to null dimensions." );
 			}
 
 			m_width = width;
 			m_height = height;
-			m_data.resize( width * height * 3 );
+			m_channels = channels;
+			m_data.resize( width * height * channels );
 		}
 
 	private :
 	
-		int m_width, m_height;
+		int m_width, m_height, m_channels;
 		std::vector<double> m_data;
 };
 
@@ -78,11 +88,52 @@ struct SampleSet
 {
 	public :
 
-		SampleSet( const std::vector< Image > &i );
+		/// When compact is true and every sample is one of the 256 values that an
+		/// 8 bit gamma encoded image can hold, the samples are stored as their 8 bit
+		/// codes and decoded through gamma22Table() when they are read. This takes an
+		/// eighth of the memory of storing them as doubles. Otherwise, or if compact
+		/// is false, the samples are stored as doubles.
+		SampleSet( const std::vector< Image > &i, bool compact = false );
+		/// Builds the set from images that are owned elsewhere, such as the
+		/// frame ring of a stream, without copying them first.
+		SampleSet( const std::vector< const Image* > &i, bool compact = false );
+
+		/// Recomputes the samples and statistics of the pixels whose entry ( y * width + x ) in changed
+		/// is non-zero from the images, which must match the ones the set was built from in number and
+		/// size. Returns false, leaving the set as it was, if the set is compact and the new samples
+		/// can't be stored as codes, in which case it needs to be built again.
+		bool update( const std::vector< const Image* > &images, const std::vector< unsigned char > &changed );
 
 		inline int width() const { return m_width; };
 		inline int height() const { return m_height; };
-		inline const std::vector<double> &samples( int x, int y, int c ) const { return m_samples[ arrayIndex( x, y, c ) ]; }
+		inline int channels() const { return m_channels; };
+		inline int nSamples() const { return m_nSamples; };
+		inline bool compact() const { return !m_codes.empty(); };
+		/// Returns the number of bytes used to store the samples.
+		inline size_t sampleBytes() const { return m_samples.size() * sizeof( double ) + m_codes.size() + m_fill.size() * sizeof( double ); };
+
+		/// Returns the samples of a pixel's channel. Compact sets decode the samples
+		/// into scratch, which must hold nSamples() values, and return it.
+		inline const double *samples( int x, int y, int c, double *scratch ) const
+		{
+			const int index = arrayIndex( x, y, c );
+			if( m_codes.empty() )
+			{
+				return &m_samples[ size_t( index ) * m_nSamples ];
+			}
+
+			// Black samples are stored as code 0 and are decoded to the value that
+			// they were replaced with when the statistics were computed.
+			const unsigned char *codes = &m_codes[ size_t( index ) * m_nSamples ];
+			const double *table = gamma22Table();
+			const double fill = m_fill[ index ];
+			for( int i = 0; i < m_nSamples; ++i )
+			{
+				scratch[i] = codes[i] == 0 ? fill : table[ codes[i] ];
+			}
+			return scratch;
+		}
+
 		inline double mean( int x, int y, int c ) const { return m_mean[ arrayIndex( x, y, c ) ]; };
 		inline double max( int x, int y, int c ) const { return m_max[ arrayIndex( x, y, c ) ]; };
 		inline double min( int x, int y, int c ) const { return m_min[ arrayIndex( x, y, c ) ]; };
@@ -98,16 +149,22 @@ struct SampleSet
 
 	private :
 
+		void init( const std::vector< const Image* > &images, bool compact );
+		/// Computes the samples and statistics of every channel of a pixel, using s as scratch.
+		void initPixel( const std::vector< const Image* > &images, int x, int y, std::vector< double > &s );
+
 		inline int arrayIndex( int x, int y, int c ) const
 		{ 
 			x = std::max( std::min( x, m_width - 1 ), 0 );
 			y = std::max( std::min( y, m_height - 1 ), 0 );
-			c = std::max( std::min( c, 3 ), 0 );
-			return ( y * m_width + x ) * 3 + c;
+			c = std::max( std::min( c, m_channels - 1 ), 0 );
+			return ( y * m_width + x ) * m_channels + c;
 		}
 
-		int m_width, m_height;
-		std::vector< std::vector< double > > m_samples;
+		int m_width, m_height, m_channels, m_nSamples;
+		std::vector< double > m_samples;
+		std::vector< unsigned char > m_codes;
+		std::vector< double > m_fill;
 		std::vector< double > m_mean, m_variance, m_deviation, m_min, m_max, m_median;
 };
 
@@ -131,6 +188,20 @@ struct BmpHeader
 	unsigned int   mImportantColors; // 0 - all are important
 };
 
+/// Copies the channels of each layer into consecutive channels of stacked so
+/// that a beauty pass and its AOVs can be filtered as a single image.
+void stackLayers( const std::vector< const Image* > &layers, Image &stacked );
+/// Copies nChannels channels, starting at firstChannel, out of stacked.
+void extractLayer( const Image &stacked, int firstChannel, int nChannels, Image &layer );
+
+/// Returns the peak signal to noise ratio in dB between the first three channels
+/// of two images once they have been encoded to 8 bits in the same way as writePPM().
+double psnr( const Image &a, const Image &b );
+
+/// Encodes the first three channels of row y to 8 bits per channel exactly as
+/// fromGamma22() would, but without evaluating a pow() per value.
+void encodeGamma22( const Image &image, int y, unsigned char *out );
+
 bool readPPM( const std::string &path, Image &image );
 bool writePPM( const std::string &path, const Image &image );
 bool writeBMP( const std::string &path, const Image &image );
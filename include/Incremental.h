@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+#ifndef _INCREMENTAL_H_
+#define _INCREMENTAL_H_
+
+#include <memory>
+
+/// A rectangle of pixels [x, x + width) x [y, y + height) which a renderer has changed.
+struct DirtyRect
+{
+	int x, y, width, height;
+};
+
+/// Keeps the sample set, the guide and the result of a denoise so that, when a renderer
+/// patches part of some of the input frames, only the statistics of the changed pixels are
+/// recomputed and only the pixels within the kernel's radius of them are filtered again.
+/// The rest of the result is copied from the previous one, which it matches exactly.
+struct IncrementalDenoiser
+{
+	public :
+
+		IncrementalDenoiser( const Options &opt );
+
+		/// Filters the frames from scratch and keeps the state for update().
+		void denoise( const std::vector< const Image* > &frames, Image &result );
+
+		/// Filters the frames again after some of them have changed. The pixels inside hints are
+		/// taken to be the only ones that changed, or when there are no hints the frames are
+		/// compared with the previous ones to find them. The frames must match the previous ones
+		/// in number and size, otherwise they are filtered from scratch. Returns the number of
+		/// pixels that were filtered.
+		int update( const std::vector< const Image* > &frames, const std::vector< DirtyRect > &hints, Image &result );
+
+	private :
+
+		/// Marks the pixels which differ in any channel of any frame from the previous frames.
+		void diff( const std::vector< const Image* > &frames, std::vector< unsigned char > &changed ) const;
+		/// Builds the guide images of the frames that opt.weightMode asks for, if any.
+		void buildGuides( const std::vector< const Image* > &frames );
+		/// Returns the pointers to m_guides for building or updating the guide set.
+		std::vector< const Image* > guidePointers() const;
+
+		Options m_opt;
+		std::vector< Image > m_frames, m_guides;
+		std::unique_ptr< SampleSet > m_set, m_guide;
+		std::unique_ptr< SourceTerms > m_terms;
+		Image m_result;
+};
+
+#endif
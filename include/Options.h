@@ -39,7 +39,41 @@ struct Options
 		sequenceNumber( 0 ),
 		startFrame( 0 ),
 		extension( "bmp" ),
-		outputPath( "denoised.bmp" )
+		outputPath( "denoised.bmp" ),
+		streamPath( "" ),
+		threads( 0 ),
+		tileSize( 0 ),
+		tileOrder( kRaster ),
+		kernelVariant( kPixelMajor ),
+		tune( kTuneOff ),
+		tuneCachePath( "" ),
+		tuneFixed( 0 ),
+		weightMode( kPerChannel ),
+		report( false ),
+		asyncWrite( false ),
+		benchmark( false ),
+		compactSamples( false ),
+		progressive( false ),
+		deadline( 0 ),
+		minKernelWidth( 0 ),
+		adaptiveNoise( .1 ),
+		chromaScale( 0 ),
+		checkpointPath( "" ),
+		checkpointInterval( 10. ),
+		imageDirectory( "images" ),
+		sequenceLength( 11 ),
+		generatePath( "" ),
+		generateSource( "" ),
+		generateWidth( 0 ),
+		generateHeight( 0 ),
+		noise( .05 ),
+		fireflies( .001 ),
+		dropouts( .05 ),
+		seed( 2014 ),
+		scaling( false ),
+		rejectEpsilon( 0. ),
+		watch( false ),
+		watchInterval( .5 )
 	{
 	}
 
@@ -49,6 +83,44 @@ struct Options
 		kGentle
 	};
 
+	/// The order in which the filter visits the pixels and channels of a tile.
+	enum
+	{
+		kPixelMajor,
+		kChannelMajor
+	};
+
+	/// The statistic that the filter's weights are computed from.
+	enum
+	{
+		kPerChannel,	///< Each channel is weighted by its own samples.
+		kLuminance,	///< The weights are computed once from the luminance and shared by every channel.
+		kMaxChannel	///< The weights are computed once from the largest channel and shared by every channel.
+	};
+
+	/// The order in which the tiles are filtered.
+	enum
+	{
+		kRaster,
+		kZOrder,
+		kHilbert
+	};
+
+	enum
+	{
+		kTuneOff,
+		kTuneCached,	///< Use the cached tuning for this host, tuning first if there isn't one.
+		kTuneForce	///< Always re-run the tuning and replace the cached result.
+	};
+
+	/// The options that the tuning picks, as bits of tuneFixed.
+	enum
+	{
+		kTuneThreads = 1,
+		kTuneTileSize = 2,
+		kTuneKernelVariant = 4
+	};
+
 	int blurMode;	
 	int nImages;
 	double blurStrength;
@@ -58,6 +130,41 @@ struct Options
 	int startFrame;
 	std::string extension;
 	std::string outputPath;
+	std::string streamPath;	///< When set, frames are read from this raw frame stream ("-" for stdin) and written to stdout.
+	int threads;	///< The number of filter threads. 0 uses one per hardware thread.
+	int tileSize;	///< 0 sizes the tiles to fit the L2 cache.
+	int tileOrder;
+	int kernelVariant;
+	int tune;
+	std::string tuneCachePath;	///< Overrides the default per-host tuning cache file.
+	int tuneFixed;	///< The kTune* bits of the tuned options that were set on the command line, which the tuning keeps.
+	std::vector< std::string > aovs;	///< AOV layers which are filtered using the weights of the beauty pass.
+	int weightMode;
+	bool report;	///< Compares the result of the faster modes with the plain filter.
+	bool asyncWrite;	///< Encodes and writes the output on a background thread.
+	bool benchmark;	///< Times the filter with each tile order instead of writing an output.
+	bool compactSamples;	///< Stores 8 bit samples as their codes rather than as doubles.
+	bool progressive;	///< Writes a coarse preview first and then refines it.
+	double deadline;	///< The seconds a progressive run may take. 0 lets it finish.
+	int minKernelWidth;	///< When set, each pixel's kernel width is picked between this and kernelWidth from its noise.
+	double adaptiveNoise;	///< The sample deviation at which an adaptive kernel reaches kernelWidth.
+	int chromaScale;	///< When set, luma is filtered at full resolution and chroma at 1 / chromaScale of it.
+	std::string checkpointPath;	///< When set, completed tiles are saved here so that a killed run can be resumed.
+	double checkpointInterval;	///< The least number of seconds between checkpoint writes.
+	std::string imageDirectory;	///< The directory that the sequences are read from.
+	int sequenceLength;	///< The number of frames in each sequence, after which it loops.
+	std::string generatePath;	///< When set, a noisy sequence is generated in this directory instead of filtering.
+	std::string generateSource;	///< The clean image the sequence is generated from. A procedural scene is used if it isn't set.
+	int generateWidth;	///< The size of the generated frames. 0 uses the size of the source.
+	int generateHeight;
+	double noise;	///< The deviation of the generated noise at a value of 1. It scales with the square root of the value.
+	double fireflies;	///< The fraction of generated samples that are saturated fireflies.
+	double dropouts;	///< The fraction of generated pixels that are black in every channel, like a missing sample.
+	unsigned int seed;
+	bool scaling;	///< Times the filter on generated sequences as the threads, resolution and number of images grow.
+	double rejectEpsilon;	///< When set, neighbours and samples whose weight can't exceed this are skipped.
+	bool watch;	///< Keeps running after writing the output and filters the changed parts of the frames again as they are rewritten.
+	double watchInterval;	///< The seconds between checks for rewritten frames.
 };
 
 bool options( int argc, char* argv[], Options &config );
@@ -0,0 +1,61 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+#ifndef _SEQUENCE_H_
+#define _SEQUENCE_H_
+
+/// Returns the path of the i'th image of the named sequence in opt.imageDirectory,
+/// looping back to the start of the sequence when the end is reached.
+std::string sequencePath( const std::string &name, const Options &opt, int i );
+
+/// Returns the path of the ground truth image for the sequence. The preset ground truths
+/// are in the working directory and those of other image directories are inside them.
+std::string groundTruthPath( const Options &opt );
+
+/// Builds a clean scene of flat areas, gradients, hard edges and a disc. It is defined
+/// in terms of the image's size so that it looks the same at any resolution.
+void proceduralScene( int width, int height, Image &scene );
+
+/// Resamples the image to the given size with bilinear filtering.
+void resizeImage( const Image &image, int width, int height, Image &resized );
+
+/// Loads opt.generateSource, or builds the procedural scene, at opt.generateWidth x opt.generateHeight,
+/// falling back to the size of the source or 512x512. Returns false if the source can't be read.
+bool generatorScene( const Options &opt, Image &scene );
+
+/// Writes frame 'frame' of a noisy sequence of the clean scene into image. Each sample gets gaussian
+/// noise with a deviation of opt.noise * sqrt( value ), opt.fireflies of them are saturated and
+/// opt.dropouts of the pixels are black in every channel, which SampleSet treats as missing samples.
+/// Other samples are kept above the smallest 8 bit value so that they are never read as missing. The
+/// frame only depends on the scene, opt.seed and the frame number, whatever the number of threads.
+void noisyFrame( const Image &scene, int frame, const Options &opt, Image &image );
+
+/// Writes a noisy sequence of opt.sequenceLength frames, and the clean scene as its ground truth,
+/// to opt.generatePath in the layout that the sequences are read in. Returns the exit code for main().
+int generateSequence( const Options &opt );
+
+#endif
@@ -0,0 +1,76 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+/// Describes a raw frame stream. A stream starts with a short text header:
+///
+///     TDS
+///     <width> <height>
+///     <u8|f32>
+///
+/// followed by a single whitespace character and then any number of frames
+/// of width * height * 3 interleaved RGB values, stored top row first. The
+/// "u8" format holds gamma 2.2 encoded bytes in the same way as a PPM while
+/// "f32" holds linear floats in the native byte order.
+struct StreamHeader
+{
+	StreamHeader() :
+		width( 0 ),
+		height( 0 ),
+		format( kByte )
+	{
+	}
+
+	enum
+	{
+		kByte,
+		kFloat
+	};
+
+	inline size_t frameSize() const { return size_t( width ) * size_t( height ) * 3 * ( format == kFloat ? sizeof( float ) : 1 ); }
+
+	int width;
+	int height;
+	int format;
+};
+
+bool readStreamHeader( FILE *f, StreamHeader &header );
+bool writeStreamHeader( FILE *f, const StreamHeader &header );
+
+/// Reads the next frame into the image using buffer as scratch space. Returns
+/// false when the stream ends cleanly on a frame boundary.
+bool readStreamFrame( FILE *f, const StreamHeader &header, std::vector< unsigned char > &buffer, Image &image );
+bool writeStreamFrame( FILE *f, const StreamHeader &header, const Image &image, std::vector< unsigned char > &buffer );
+
+/// Reads frames from opt.streamPath and writes a denoised frame to stdout as
+/// soon as each window of opt.nImages frames is complete. Returns the exit
+/// code for main().
+int denoiseStream( const Options &opt );
+
+#endif
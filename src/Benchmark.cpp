@@ -0,0 +1,270 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "Options.h"
+#include "Image.h"
+#include "Filter.h"
+#include "Sequence.h"
+#include "Benchmark.h"
+
+EventCounter::EventCounter( int event ) :
+	m_fd( -1 )
+{
+#ifdef __linux__
+	perf_event_attr attr;
+	memset( &attr, 0, sizeof( attr ) );
+	attr.size = sizeof( attr );
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = event == kCacheMisses ? PERF_COUNT_HW_CACHE_MISSES : PERF_COUNT_HW_CACHE_REFERENCES;
+	attr.disabled = 1;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	m_fd = int( syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 ) );
+#endif
+}
+
+EventCounter::~EventCounter()
+{
+	if( m_fd >= 0 )
+	{
+		close( m_fd );
+	}
+}
+
+void EventCounter::start()
+{
+#ifdef __linux__
+	if( m_fd >= 0 )
+	{
+		ioctl( m_fd, PERF_EVENT_IOC_RESET, 0 );
+		ioctl( m_fd, PERF_EVENT_IOC_ENABLE, 0 );
+	}
+#endif
+}
+
+long long EventCounter::stop()
+{
+	long long count = -1;
+#ifdef __linux__
+	if( m_fd >= 0 )
+	{
+		ioctl( m_fd, PERF_EVENT_IOC_DISABLE, 0 );
+		if( read( m_fd, &count, sizeof( count ) ) != sizeof( count ) )
+		{
+			count = -1;
+		}
+	}
+#endif
+	return count;
+}
+
+int benchmark( const std::vector< const Image* > &frames, const Options &opt )
+{
+	SampleSet set( frames, opt.compactSamples );
+	std::unique_ptr< SampleSet > guide = weightGuideSet( frames, opt );
+	const SampleSet &weights = guide ? *guide : set;
+	SourceTerms terms( weights );
+
+	EventCounter references( EventCounter::kCacheReferences ), misses( EventCounter::kCacheMisses );
+	if( !misses.valid() )
+	{
+		std::cerr << "Cache misses can't be counted on this system so only the times are reported." << std::endl;
+	}
+
+	struct Run
+	{
+		const char *name;
+		int tileSize;
+		int tileOrder;
+	};
+
+	// A single tile covering the whole image visits the pixels in plain raster order. It can only be
+	// filtered by one thread, so every traversal runs on one thread to keep the runs comparable.
+	Options benchOpt = opt;
+	benchOpt.threads = 1;
+	const int tileSize = filterTileSize( weights, set, benchOpt );
+	const Run runs[] =
+	{
+		{ "Untiled", std::max( set.width(), set.height() ), Options::kRaster },
+		{ "Raster tiles", tileSize, Options::kRaster },
+		{ "Z-order tiles", tileSize, Options::kZOrder },
+		{ "Hilbert tiles", tileSize, Options::kHilbert },
+	};
+
+	fprintf( stderr, "Benchmarking a %dx%d image with %d thread and %dx%d tiles.\n", set.width(), set.height(), filterThreads( benchOpt ), tileSize, tileSize );
+	fprintf( stderr, "%-16s %10s %16s %16s %10s\n", "Traversal", "Time (s)", "Cache refs", "Cache misses", "Miss rate" );
+
+	Image result;
+	long long untiledMisses = -1;
+	for( unsigned int r = 0; r < sizeof( runs ) / sizeof( Run ); ++r )
+	{
+		Options runOpt = benchOpt;
+		runOpt.tileSize = runs[r].tileSize;
+		runOpt.tileOrder = runs[r].tileOrder;
+
+		references.start();
+		misses.start();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		filter( weights, terms, set, runOpt, result, false );
+		double time = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+		long long missCount = misses.stop();
+		long long referenceCount = references.stop();
+
+		if( r == 0 )
+		{
+			untiledMisses = missCount;
+		}
+
+		fprintf( stderr, "%-16s %10.3f ", runs[r].name, time );
+		if( missCount >= 0 && referenceCount > 0 )
+		{
+			fprintf( stderr, "%16lld %16lld %9.2f%%", referenceCount, missCount, 100. * missCount / referenceCount );
+			if( r > 0 && untiledMisses > 0 )
+			{
+				fprintf( stderr, " (%.1f%% fewer misses than untiled)", 100. * ( untiledMisses - missCount ) / untiledMisses );
+			}
+		}
+		else
+		{
+			fprintf( stderr, "%16s %16s %10s", "n/a", "n/a", "n/a" );
+		}
+		fprintf( stderr, "\n" );
+	}
+
+	return 0;
+}
+
+int scaling( const Options &opt )
+{
+	Image scene;
+	if( !generatorScene( opt, scene ) )
+	{
+		return 1;
+	}
+
+	struct Run
+	{
+		const char *curve;
+		int threads;
+		int width, height;
+		int nImages;
+	};
+
+	// Each curve doubles one parameter up to its limit while the others stay at theirs.
+	const int maxThreads = filterThreads( opt ), maxImages = std::max( opt.nImages, 2 );
+	std::vector< Run > runs;
+	for( int t = 1; ; t = std::min( t * 2, maxThreads ) )
+	{
+		Run run = { "Threads", t, scene.width(), scene.height(), maxImages };
+		runs.push_back( run );
+		if( t == maxThreads ) break;
+	}
+	for( int scale = 4; scale >= 1; scale /= 2 )
+	{
+		if( scene.width() / scale >= 16 && scene.height() / scale >= 16 )
+		{
+			Run run = { "Resolution", maxThreads, scene.width() / scale, scene.height() / scale, maxImages };
+			runs.push_back( run );
+		}
+	}
+	for( int n = 2; ; n = std::min( n * 2, maxImages ) )
+	{
+		Run run = { "Images", maxThreads, scene.width(), scene.height(), n };
+		runs.push_back( run );
+		if( n == maxImages ) break;
+	}
+
+	fprintf( stderr, "Timing the filter on generated sequences with noise %g, fireflies %g and dropouts %g.\n", opt.noise, opt.fireflies, opt.dropouts );
+	fprintf( stderr, "%-12s %8s %12s %8s %10s %10s %12s %9s\n", "Curve", "Threads", "Size", "Images", "Setup (s)", "Filter (s)", "Mpixels/s", "Rel. rate" );
+
+	Image resized, result;
+	const char *curve = "";
+	double first = 0.;
+	for( unsigned int r = 0; r < runs.size(); ++r )
+	{
+		Options runOpt = opt;
+		runOpt.threads = runs[r].threads;
+		const Image *source = &scene;
+		if( runs[r].width != scene.width() || runs[r].height != scene.height() )
+		{
+			resizeImage( scene, runs[r].width, runs[r].height, resized );
+			source = &resized;
+		}
+
+		std::vector< Image > images( runs[r].nImages );
+		std::vector< const Image* > frames( images.size() );
+		for( unsigned int i = 0; i < images.size(); ++i )
+		{
+			noisyFrame( *source, i, runOpt, images[i] );
+			frames[i] = &images[i];
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		SampleSet set( frames, opt.compactSamples );
+		std::unique_ptr< SampleSet > guide = weightGuideSet( frames, runOpt );
+		const SampleSet &weights = guide ? *guide : set;
+		SourceTerms terms( weights );
+		std::chrono::steady_clock::time_point filterStart = std::chrono::steady_clock::now();
+		filter( weights, terms, set, runOpt, result, false );
+		double setupTime = std::chrono::duration< double >( filterStart - start ).count();
+		double filterTime = std::chrono::duration< double >( std::chrono::steady_clock::now() - filterStart ).count();
+
+		// The rate of samples filtered relative to the first run of the curve, which is the speed-up
+		// along the threads curve and the efficiency along the others.
+		const double throughput = runs[r].width * double( runs[r].height ) / filterTime / 1e6;
+		if( strcmp( curve, runs[r].curve ) != 0 )
+		{
+			curve = runs[r].curve;
+			first = throughput * runs[r].nImages;
+		}
+		char size[32];
+		snprintf( size, sizeof( size ), "%dx%d", runs[r].width, runs[r].height );
+		fprintf( stderr, "%-12s %8d %12s %8d %10.3f %10.3f %12.3f %9.2f\n", runs[r].curve, runs[r].threads, size, runs[r].nImages, setupTime, filterTime, throughput, throughput * runs[r].nImages / first );
+	}
+
+	return 0;
+}
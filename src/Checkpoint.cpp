@@ -0,0 +1,325 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "Options.h"
+#include "Image.h"
+#include "Filter.h"
+#include "Checkpoint.h"
+
+namespace
+{
+
+const char *kCheckpointMagic = "TDCHECKPOINT 1";
+const uint32_t kTileMagic = 0x454c4954; // "TILE"
+
+/// The header of each tile record, which is followed by the tile's pixels as doubles.
+struct TileRecord
+{
+	uint32_t magic;
+	int32_t x0, y0, x1, y1;
+	/// Pads the checksum to its alignment, so that no uninitialised bytes are written.
+	int32_t reserved;
+	uint64_t checksum;
+};
+static_assert( sizeof( TileRecord ) == 32, "A tile record must have no hidden padding." );
+
+/// A 64 bit FNV-1a hash, taken a word at a time for speed.
+inline uint64_t hashWords( const void *data, size_t bytes, uint64_t hash = 14695981039346656037ULL )
+{
+	const unsigned char *p = static_cast< const unsigned char* >( data );
+	for( ; bytes >= 8; bytes -= 8, p += 8 )
+	{
+		uint64_t word;
+		memcpy( &word, p, 8 );
+		hash = ( hash ^ word ) * 1099511628211ULL;
+	}
+	for( ; bytes > 0; --bytes, ++p )
+	{
+		hash = ( hash ^ *p ) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+/// Describes the options that change the filtered result.
+std::string optionsText( const Options &opt, int nImages )
+{
+	std::stringstream s;
+	s << std::setprecision( 17 );
+	s << "blurMode " << opt.blurMode << " nImages " << nImages << " blurStrength " << opt.blurStrength;
+	s << " contributionStrength " << opt.contributionStrength << " kernelWidth " << opt.kernelWidth;
+	s << " weightMode " << opt.weightMode << " minKernelWidth " << opt.minKernelWidth << " adaptiveNoise " << opt.adaptiveNoise;
+	s << " rejectEpsilon " << opt.rejectEpsilon;
+	return s.str();
+}
+
+/// Appends the tiles of a result to a sidecar file.
+class CheckpointWriter
+{
+	public :
+
+		CheckpointWriter( FILE *file, const Image &result, double interval ) :
+			m_file( file ),
+			m_result( result ),
+			m_interval( interval ),
+			m_lastWrite( std::chrono::steady_clock::now() ),
+			m_failed( false ),
+			m_tiles( 0 ),
+			m_writes( 0 ),
+			m_bytes( 0 ),
+			m_time( 0. )
+		{
+		}
+
+		/// Called by the filter's threads as each tile is completed.
+		void tileDone( int x0, int y0, int x1, int y1 )
+		{
+			std::lock_guard< std::mutex > lock( m_mutex );
+			TileRecord record = { kTileMagic, x0, y0, x1, y1, 0, 0 };
+			m_pending.push_back( record );
+			if( std::chrono::duration< double >( std::chrono::steady_clock::now() - m_lastWrite ).count() >= m_interval )
+			{
+				write();
+			}
+		}
+
+		/// Writes the tiles that have been completed since the last write.
+		void flush()
+		{
+			std::lock_guard< std::mutex > lock( m_mutex );
+			write();
+		}
+
+		bool failed() const { return m_failed; }
+		int tiles() const { return m_tiles; }
+		int writes() const { return m_writes; }
+		size_t bytes() const { return m_bytes; }
+		double time() const { return m_time; }
+
+	private :
+
+		void write()
+		{
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			const int channels = m_result.channels();
+			for( unsigned int i = 0; i < m_pending.size() && !m_failed; ++i )
+			{
+				TileRecord &record = m_pending[i];
+				m_row.clear();
+				for( int y = record.y0; y < record.y1; ++y )
+				{
+					const double *row = m_result.readable( record.x0, y );
+					m_row.insert( m_row.end(), row, row + ( record.x1 - record.x0 ) * channels );
+				}
+				record.checksum = hashWords( &m_row[0], m_row.size() * sizeof( double ) );
+				m_failed = fwrite( &record, sizeof( record ), 1, m_file ) != 1 || fwrite( &m_row[0], sizeof( double ), m_row.size(), m_file ) != m_row.size();
+				m_bytes += sizeof( record ) + m_row.size() * sizeof( double );
+				++m_tiles;
+			}
+			if( !m_pending.empty() )
+			{
+				// Flushing hands the tiles to the system, which keeps them if the process is killed.
+				m_failed = fflush( m_file ) != 0 || m_failed;
+				++m_writes;
+			}
+			m_pending.clear();
+
+			m_lastWrite = std::chrono::steady_clock::now();
+			m_time += std::chrono::duration< double >( m_lastWrite - start ).count();
+		}
+
+		FILE *m_file;
+		const Image &m_result;
+		double m_interval;
+		std::chrono::steady_clock::time_point m_lastWrite;
+		std::mutex m_mutex;
+		std::vector< TileRecord > m_pending;
+		std::vector< double > m_row;
+		bool m_failed;
+		int m_tiles, m_writes;
+		size_t m_bytes;
+		double m_time;
+};
+
+/// Reads the tiles of a sidecar that matches the header into result, clearing their pixels in
+/// mask, and returns the size of the valid part of the file, or 0 if it doesn't match.
+long restoreTiles( const std::string &path, const std::string &header, Image &result, std::vector< unsigned char > &mask, int &restored )
+{
+	restored = 0;
+	FILE *file = fopen( path.c_str(), "rb" );
+	if( file == NULL )
+	{
+		return 0;
+	}
+
+	std::vector< char > text( header.size() );
+	if( fread( &text[0], 1, text.size(), file ) != text.size() || std::string( text.begin(), text.end() ) != header )
+	{
+		fclose( file );
+		return 0;
+	}
+
+	// A run that was killed while writing leaves a partial record at the end, which is dropped.
+	const int width = result.width(), height = result.height(), channels = result.channels();
+	long valid = ftell( file );
+	TileRecord record;
+	std::vector< double > pixels;
+	while( fread( &record, sizeof( record ), 1, file ) == 1 )
+	{
+		if( record.magic != kTileMagic || record.x0 < 0 || record.y0 < 0 || record.x1 > width || record.y1 > height || record.x0 >= record.x1 || record.y0 >= record.y1 )
+		{
+			break;
+		}
+		const int tileWidth = record.x1 - record.x0;
+		pixels.resize( tileWidth * ( record.y1 - record.y0 ) * channels );
+		if( fread( &pixels[0], sizeof( double ), pixels.size(), file ) != pixels.size() || hashWords( &pixels[0], pixels.size() * sizeof( double ) ) != record.checksum )
+		{
+			break;
+		}
+
+		for( int y = record.y0; y < record.y1; ++y )
+		{
+			std::copy( &pixels[ ( y - record.y0 ) * tileWidth * channels ], &pixels[ ( y - record.y0 + 1 ) * tileWidth * channels ], result.writeable( record.x0, y ) );
+			for( int x = record.x0; x < record.x1; ++x )
+			{
+				restored += mask[ y * width + x ];
+				mask[ y * width + x ] = 0;
+			}
+		}
+		valid = ftell( file );
+	}
+
+	fclose( file );
+	return valid;
+}
+
+} // namespace
+
+bool denoiseWithCheckpoints( const std::vector< const Image* > &images, const Options &opt, Image &result, bool showProgress )
+{
+	if( opt.chromaScale > 0 )
+	{
+		std::cerr << "Checkpoints can't be used with --lumaChroma." << std::endl;
+		return false;
+	}
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	SampleSet set( images, opt.compactSamples );
+	std::unique_ptr< SampleSet > guide = weightGuideSet( images, opt );
+	const SampleSet &weights = guide ? *guide : set;
+	const int width = set.width(), height = set.height(), channels = set.channels();
+
+	// The fingerprint covers the options and every input sample, so a sidecar is only used
+	// to resume the run that wrote it.
+	std::chrono::steady_clock::time_point setupStart = std::chrono::steady_clock::now();
+	const std::string options = optionsText( opt, int( images.size() ) );
+	uint64_t fingerprint = hashWords( options.data(), options.size() );
+	for( unsigned int i = 0; i < images.size(); ++i )
+	{
+		fingerprint = hashWords( images[i]->readable( 0, 0 ), size_t( width ) * height * images[i]->channels() * sizeof( double ), fingerprint );
+	}
+	std::stringstream header;
+	header << kCheckpointMagic << "\n" << width << " " << height << " " << channels << "\n" << options << "\n" << std::hex << std::setw( 16 ) << std::setfill( '0' ) << fingerprint << "\n";
+
+	result.resize( width, height, channels );
+	std::vector< unsigned char > mask( width * height, 1 );
+	int restored = 0;
+	const long valid = restoreTiles( opt.checkpointPath, header.str(), result, mask, restored );
+
+	FILE *file = NULL;
+	if( valid > 0 )
+	{
+		if( truncate( opt.checkpointPath.c_str(), valid ) == 0 )
+		{
+			file = fopen( opt.checkpointPath.c_str(), "ab" );
+		}
+		if( showProgress )
+		{
+			fprintf( stderr, "Resuming from \"%s\" with %.1f%% of the pixels already filtered.\n", opt.checkpointPath.c_str(), 100. * restored / ( width * height ) );
+		}
+	}
+	else
+	{
+		if( showProgress && access( opt.checkpointPath.c_str(), F_OK ) == 0 )
+		{
+			fprintf( stderr, "The checkpoint \"%s\" was written for other options or inputs so it is started again.\n", opt.checkpointPath.c_str() );
+		}
+		file = fopen( opt.checkpointPath.c_str(), "wb" );
+		if( file != NULL && ( fputs( header.str().c_str(), file ) < 0 || fflush( file ) != 0 ) )
+		{
+			fclose( file );
+			file = NULL;
+		}
+	}
+	if( file == NULL )
+	{
+		std::cerr << "Failed to open the checkpoint \"" << opt.checkpointPath << "\"." << std::endl;
+		return false;
+	}
+	double setupTime = std::chrono::duration< double >( std::chrono::steady_clock::now() - setupStart ).count();
+
+	CheckpointWriter writer( file, result, opt.checkpointInterval );
+	SourceTerms terms( weights );
+	FilterControl control;
+	control.mask = &mask;
+	control.showProgress = showProgress;
+	control.tileDone = [&writer]( int x0, int y0, int x1, int y1 ) { writer.tileDone( x0, y0, x1, y1 ); };
+	filter( weights, terms, set, opt, result, control );
+	writer.flush();
+	const bool closed = fclose( file ) == 0;
+
+	if( showProgress )
+	{
+		const double time = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+		const double overhead = setupTime + writer.time();
+		fprintf( stderr, "Checkpointed %d tiles in %d writes of %.1fMB in total, taking %.3fs or %.2f%% of the run.\n", writer.tiles(), writer.writes(), writer.bytes() / ( 1024. * 1024. ), overhead, 100. * overhead / time );
+	}
+
+	if( writer.failed() || !closed )
+	{
+		std::cerr << "Failed to write the checkpoint \"" << opt.checkpointPath << "\"." << std::endl;
+		return false;
+	}
+	return true;
+}
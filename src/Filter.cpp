@@ -0,0 +1,824 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <memory>
+
+#include "Options.h"
+#include "Image.h"
+#include "Filter.h"
+#include "LumaChroma.h"
+
+/// Returns the Gaussian weight for a point 'x' in a normal distribution
+/// centered at the mean with the given deviation.
+double gaussian( double x, double mean, double deviation, bool normalize )
+{
+	double c = deviation;
+	double a = c * sqrt( 2 * M_PI );
+	double b = x - mean;
+	double v = a * exp( -( ( b * b ) / ( 2*c*c ) ) );
+	return normalize ? v / a : v;
+}
+
+/// A step function which has a falloff that starts when the value 'x'
+/// gets within 10% of a limit. The returned value will never reach 0
+/// if it is within range. Values of 'x' that are out of the range 
+/// are set to 0.
+double softStep( double x, double min, double max )
+{
+	if( x < min || x > max )
+	{
+		return 0;
+	}
+
+	double v = ( max - min ) * .1;
+	double lower = min + v;
+	double upper = max - v;
+	if( x < min + v )
+	{
+		x = ( x - min ) / ( lower - min );
+	}
+	else if( x > max - v )
+	{
+		x = 1. - ( x - upper ) / ( max - upper );
+	}
+	else
+	{
+		return 1.;
+	}
+
+	// We ensure that the weight returns a contribution of at least .0025;
+	x = .05 + ( x * .95 );
+
+	return x * x;
+}
+
+SourceTerms::SourceTerms( const SampleSet &guide ) :
+	m_width( guide.width() ),
+	m_height( guide.height() ),
+	m_channels( std::min( guide.channels(), 3 ) ),
+	m_samples( guide.nSamples() )
+{
+	const int arraySize = m_width * m_height * m_channels * m_samples;
+	m_likelihood.resize( arraySize );
+	m_limitWeight.resize( arraySize );
+
+	std::vector< double > scratch( m_samples );
+	for( int y = 0; y < m_height; ++y )
+	{
+		for( int x = 0; x < m_width; ++x )
+		{
+			computePixel( guide, x, y, scratch );
+		}
+	}
+}
+
+void SourceTerms::update( const SampleSet &guide, const std::vector< unsigned char > &changed )
+{
+	if( guide.width() != m_width || guide.height() != m_height || std::min( guide.channels(), 3 ) != m_channels || guide.nSamples() != m_samples )
+	{
+		throw std::runtime_error( "The guide doesn't match the terms." );
+	}
+
+	std::vector< double > scratch( m_samples );
+	for( int p = 0; p < m_width * m_height; ++p )
+	{
+		if( changed[p] )
+		{
+			computePixel( guide, p % m_width, p / m_width, scratch );
+		}
+	}
+}
+
+void SourceTerms::computePixel( const SampleSet &guide, int x, int y, std::vector< double > &scratch )
+{
+	int index = arrayIndex( x, y, 0 );
+	for( int c = 0; c < m_channels; ++c )
+	{
+		const double *samples = guide.samples( x, y, c, &scratch[0] );
+		const double mean = guide.mean( x, y, c );
+		const double deviation = guide.deviation( x, y, c );
+		const double min = guide.min( x, y, c );
+		const double max = guide.max( x, y, c );
+		for( int i = 0; i < m_samples; ++i, ++index )
+		{
+			m_likelihood[index] = gaussian( samples[i], mean, deviation );
+			m_limitWeight[index] = m_samples <= 2 ? 1. : softStep( samples[i], min, max );
+		}
+	}
+}
+
+namespace
+{
+
+/// The weights are computed from the first layer of the guide, which is the beauty pass or
+/// a single channel statistic of it, and channel c of every layer of the set is filtered
+/// using the weights of guide channel c modulo the number of guide channels.
+inline int guideChannels( const SampleSet &guide )
+{
+	return std::min( guide.channels(), 3 );
+}
+
+/// The largest change, relative to the largest difference between a sample and a pixel's
+/// mean, that early rejection may make to a pixel. It is a fraction of an 8 bit step.
+const double kMaxRejectionError = 1e-3;
+
+/// Counts the work that early rejection skipped and the bound on the error it caused.
+struct RejectionStats
+{
+	RejectionStats() : neighbours( 0 ), skippedNeighbours( 0 ), samples( 0 ), skippedSamples( 0 ), wastedSamples( 0 ), pixels( 0 ), exactPixels( 0 ), maxError( 0. ), sumError( 0. ) {}
+
+	void add( const RejectionStats &other )
+	{
+		neighbours += other.neighbours;
+		skippedNeighbours += other.skippedNeighbours;
+		samples += other.samples;
+		skippedSamples += other.skippedSamples;
+		wastedSamples += other.wastedSamples;
+		pixels += other.pixels;
+		exactPixels += other.exactPixels;
+		maxError = std::max( maxError, other.maxError );
+		sumError += other.sumError;
+	}
+
+	long long neighbours, skippedNeighbours, samples, skippedSamples;
+	long long wastedSamples;	///< The samples evaluated by the first pass of the pixels that were then filtered exactly.
+	long long pixels, exactPixels;
+	double maxError, sumError;	///< Relative to the largest difference between a sample and a pixel's mean.
+};
+
+/// Storage for the layers that share the weights of a guide channel, allocated once per tile.
+/// The samples of compact sets are decoded into the decoded buffer.
+struct LayerScratch
+{
+	LayerScratch( int layers, int nSamples ) :
+		destMean( layers ),
+		offset( layers ),
+		decoded( ( layers + 1 ) * nSamples ),
+		samples( layers )
+	{
+	}
+
+	std::vector< double > destMean, offset, decoded;
+	std::vector< const double* > samples;
+	RejectionStats rejection;
+};
+
+/// Computes the weights of guide channel c of a pixel and filters every channel of the set
+/// that shares them, writing the results into out.
+/// When Reject is set, the neighbours and samples whose weight can't reach exp( -rejection )
+/// are skipped without evaluating it. The skipped weights are counted as exp( -rejection ) each in the
+/// error bound, and the pixel is filtered again without rejection if they could move it by more than
+/// kMaxRejectionError of the largest sample offset.
+template< bool Reject >
+inline void filterPixel( const SampleSet &guide, const SourceTerms &terms, const SampleSet &set, const Options &opt, const std::vector< double > &distanceWeights, int kernelRadius, int x, int y, int c, double rejection, LayerScratch &layers, double *out )
+{
+	const int kernelWidth = kernelRadius * 2 + 1;
+	const int stride = guideChannels( guide );
+	const int nLayers = ( set.channels() - c + stride - 1 ) / stride;
+	const int nSamples = guide.nSamples();
+	for( int l = 0; l < nLayers; ++l )
+	{
+		layers.destMean[l] = set.mean( x, y, c + l * stride );
+		layers.offset[l] = 0.;
+	}
+
+	double destMean = guide.mean( x, y, c );
+	double destDeviation = guide.deviation( x, y, c );
+	double destRange = guide.max( x, y, c ) - guide.min( x, y, c ); 
+
+	// Loop over the neighbouring pixels.
+	double weightedSum = 0.;
+	RejectionStats rejected;
+	long long skipped = 0;
+	for( int ky = -kernelRadius; ky <= kernelRadius; ++ky )
+	{
+		for( int kx = -kernelRadius; kx <= kernelRadius; ++kx )
+		{
+			// Don't include the pixel being sampled in our calculations as we are
+			// summing the deviations from it and doing so will bias our results.
+			if( ky == 0 && kx == 0 )
+			{
+				continue;
+			}
+
+			// Gather information on the source pixel's samples.
+			const double *srcSamples = guide.samples( x + kx, y + ky, c, &layers.decoded[0] );
+			const double *srcLikelihood = terms.likelihood( x + kx, y + ky, c );
+			const double *srcLimitWeight = terms.limitWeight( x + kx, y + ky, c );
+			double srcMean = guide.mean( x + kx, y + ky, c );
+			double srcVariation = guide.variance( x + kx, y + ky, c );
+			double srcRange = guide.max( x + kx, y + ky, c ) - guide.min( x + kx, y + ky, c ); 
+			
+			if( srcVariation == 0 && srcSamples[0] == 0. ) continue;
+
+			for( int l = 0; l < nLayers; ++l )
+			{
+				layers.samples[l] = set.samples( x + kx, y + ky, c + l * stride, &layers.decoded[ ( l + 1 ) * nSamples ] );
+			}
+				
+			double distanceWeight = distanceWeights[ ( ky + kernelRadius ) * kernelWidth + kx + kernelRadius ];
+				
+			// Similarity weight.
+			// This weight defines a measure of how similar the set of contributing samples is to the pixel being filtered.
+			// By itself it will produce a smart blur of sorts which is then attenuated by the variance of the source samples in the process of weighted offsets.
+			// Changing this value will effect how aggressive the filtering is.
+			double similarity;
+			if( opt.blurMode == Options::kAggressive )
+			{
+				similarity = ( srcMean - destMean ) * ( srcRange - destRange );
+			}
+			else
+			{
+				similarity = ( srcMean - destMean );
+			}
+			similarity *= similarity;
+
+			// Temporal weight.
+			// Weight the contribution using a function in the range of 0-1 which weights the importance of the
+			// contributing sample according to how close it is in time to the current time.
+			double time = 1.; // \todo: implement this! Example functions are Median, Gaussian, etc.
+
+			// The contribution, limit and time weights are at most 1 so the weight of every sample is at most
+			// exp( -similarity / ( srcVariation * distanceWeight ) ), and exactly 0 when the variation is 0.
+			const double maxDenominator = srcVariation * time * distanceWeight;
+			if( Reject )
+			{
+				++rejected.neighbours;
+				rejected.samples += nSamples;
+				if( maxDenominator <= 0. || similarity > rejection * maxDenominator )
+				{
+					++rejected.skippedNeighbours;
+					rejected.skippedSamples += nSamples;
+					skipped += maxDenominator > 0. ? nSamples : 0;
+					continue;
+				}
+			}
+
+			// Loop over each of the neighbouring samples.
+			for( int i = 0; i < nSamples; ++i )
+			{
+				// The gaussian in the contribution is at most 1, which bounds the weight of the sample.
+				if( Reject && similarity > rejection * ( srcLikelihood[i] * ( 1. - opt.blurStrength ) + opt.blurStrength ) * maxDenominator * srcLimitWeight[i] )
+				{
+					++rejected.skippedSamples;
+					++skipped;
+					continue;
+				}
+
+				// The contribution weight extends the range of allowed samples that can influence the pixel being filtered.
+				// It is simply a scaler that increases the width of the bell curve that the samples are weighted against.
+				double contribution = gaussian( srcSamples[i], destMean, destDeviation * ( 1 + opt.contributionStrength ) ) * srcLikelihood[i];
+				contribution = contribution * ( 1. - opt.blurStrength ) + opt.blurStrength;
+
+				// With the contribution known the weight is only bounded by the limit weight.
+				if( Reject && similarity > rejection * contribution * maxDenominator * srcLimitWeight[i] )
+				{
+					++rejected.skippedSamples;
+					++skipped;
+					continue;
+				}
+
+				// This weight is a step function with a strong falloff close to the limits. However, it will never reach 0 so that the sample is not excluded.
+				// By using this weight the dependency on the limiting samples is much less which reduces the effect of sparkling artefacts.
+				double limitWeight = srcLimitWeight[i];
+			
+				// Combine the weights together and normalize to the range of 0-1.	
+				double weight = pow( M_E, -( similarity / ( contribution * srcVariation * time * distanceWeight * limitWeight ) ) );
+				weight = ( isnan( weight ) || isinf( weight ) ) ? 0. : weight;
+			
+				// Sum the offset of every channel that shares the weight.
+				for( int l = 0; l < nLayers; ++l )
+				{
+					layers.offset[l] += ( layers.samples[l][i] - layers.destMean[l] ) * weight;
+				}
+
+				// Sum the weight.
+				weightedSum += weight;
+			}
+		}
+	}
+
+	if( Reject )
+	{
+		// Leaving out weights which sum to at most skippedWeight moves the result by at most
+		// 2 * skippedWeight / ( weightedSum + skippedWeight ) of the largest sample offset.
+		const double skippedWeight = skipped * exp( -rejection );
+		rejected.pixels = 1;
+		if( skippedWeight > 0. && 2. * skippedWeight > kMaxRejectionError * ( weightedSum + skippedWeight ) )
+		{
+			// The exact pass evaluates everything, and the samples that the first pass evaluated are wasted.
+			++layers.rejection.pixels;
+			++layers.rejection.exactPixels;
+			layers.rejection.neighbours += rejected.neighbours;
+			layers.rejection.samples += rejected.samples;
+			layers.rejection.wastedSamples += rejected.samples - rejected.skippedSamples;
+			filterPixel< false >( guide, terms, set, opt, distanceWeights, kernelRadius, x, y, c, 0., layers, out );
+			return;
+		}
+		rejected.maxError = skippedWeight > 0. ? 2. * skippedWeight / ( weightedSum + skippedWeight ) : 0.;
+		rejected.sumError = rejected.maxError;
+		layers.rejection.add( rejected );
+	}
+
+	for( int l = 0; l < nLayers; ++l )
+	{
+		const int channel = c + l * stride;
+		if( weightedSum == 0. || set.variance( x, y, channel ) <= 0. )
+		{
+			out[channel] = layers.destMean[l];
+		}
+		else
+		{
+			out[channel] = layers.destMean[l] + ( layers.offset[l] / weightedSum );
+		}
+	}
+}
+
+/// Picks the kernel radius of each channel of each guide pixel ( ( y * width + x ) * channels + c )
+/// between the two radii. The radius grows with the deviation of the pixel's samples and reaches
+/// maxRadius at opt.adaptiveNoise, so converged pixels are filtered with the smallest kernel.
+void kernelRadii( const SampleSet &guide, const Options &opt, int minRadius, int maxRadius, std::vector< unsigned short > &radii )
+{
+	const int width = guide.width(), height = guide.height(), nGuides = guideChannels( guide );
+	radii.resize( width * height * nGuides );
+	for( int y = 0; y < height; ++y )
+	{
+		for( int x = 0; x < width; ++x )
+		{
+			for( int c = 0; c < nGuides; ++c )
+			{
+				const double noise = opt.adaptiveNoise > 0. ? std::min( guide.deviation( x, y, c ) / opt.adaptiveNoise, 1. ) : 1.;
+				radii[ ( y * width + x ) * nGuides + c ] = minRadius + int( ceil( ( maxRadius - minRadius ) * noise ) );
+			}
+		}
+	}
+}
+
+/// Filters the pixels in the tile [x0, x1) x [y0, y1) in the order given by opt.kernelVariant. Each
+/// pixel is filtered with the kernel in radii, or kernelRadius when there are none, whose distance
+/// weights are distanceWeights[radius]. Returns the number of pixels that the mask let through.
+int filterTile( const SampleSet &guide, const SourceTerms &terms, const SampleSet &set, const Options &opt, const std::vector< std::vector< double > > &distanceWeights, int kernelRadius, const unsigned short *radii, int x0, int y0, int x1, int y1, const unsigned char *mask, Image &result, RejectionStats &rejection )
+{
+	const int width = set.width();
+	const int nGuides = guideChannels( guide );
+	const double threshold = opt.rejectEpsilon > 0. ? -log( opt.rejectEpsilon ) : 0.;
+	int filtered = 0;
+	LayerScratch layers( ( set.channels() + nGuides - 1 ) / nGuides, set.nSamples() );
+	if( opt.kernelVariant == Options::kChannelMajor )
+	{
+		// Filtering a whole channel of the tile before moving on to the next keeps
+		// the statistics of only one channel in use at a time.
+		for( int c = 0; c < nGuides; ++c )
+		{
+			for( int y = y0; y < y1; ++y )
+			{
+				for( int x = x0; x < x1; ++x )
+				{
+					if( mask && !mask[ y * width + x ] )
+					{
+						continue;
+					}
+					filtered += c == 0;
+					const int radius = radii ? radii[ ( y * width + x ) * nGuides + c ] : kernelRadius;
+					double *out = result.writeable( x, y );
+					if( threshold > 0. )
+					{
+						filterPixel< true >( guide, terms, set, opt, distanceWeights[radius], radius, x, y, c, threshold, layers, out );
+					}
+					else
+					{
+						filterPixel< false >( guide, terms, set, opt, distanceWeights[radius], radius, x, y, c, threshold, layers, out );
+					}
+				}
+			}
+		}
+	}
+	else
+	{
+		for( int y = y0; y < y1; ++y )
+		{
+			for( int x = x0; x < x1; ++x )
+			{
+				if( mask && !mask[ y * width + x ] )
+				{
+					continue;
+				}
+				++filtered;
+				double *out = result.writeable( x, y );
+				for( int c = 0; c < nGuides; ++c )
+				{
+					const int radius = radii ? radii[ ( y * width + x ) * nGuides + c ] : kernelRadius;
+					if( threshold > 0. )
+					{
+						filterPixel< true >( guide, terms, set, opt, distanceWeights[radius], radius, x, y, c, threshold, layers, out );
+					}
+					else
+					{
+						filterPixel< false >( guide, terms, set, opt, distanceWeights[radius], radius, x, y, c, threshold, layers, out );
+					}
+				}
+			}
+		}
+	}
+
+	rejection.add( layers.rejection );
+	return filtered;
+}
+
+} // namespace
+
+void weightGuide( const Image &image, const Options &opt, Image &guide )
+{
+	guide.resize( image.width(), image.height(), 1 );
+	for( int y = 0; y < image.height(); ++y )
+	{
+		for( int x = 0; x < image.width(); ++x )
+		{
+			const double *pixel = image.at( x, y );
+			if( opt.weightMode == Options::kMaxChannel )
+			{
+				guide.writeable( x, y )[0] = std::max( pixel[0], std::max( pixel[1], pixel[2] ) );
+			}
+			else
+			{
+				// Rec. 709 luminance.
+				guide.writeable( x, y )[0] = .2126 * pixel[0] + .7152 * pixel[1] + .0722 * pixel[2];
+			}
+		}
+	}
+}
+
+int filterTileSize( const SampleSet &guide, const SampleSet &set, const Options &opt )
+{
+	if( opt.tileSize > 0 )
+	{
+		return opt.tileSize;
+	}
+
+	// Estimate the bytes that filtering a pixel touches: the samples, statistics and
+	// precomputed terms of each guide channel, and the samples and statistics of every
+	// channel of the set when it isn't the guide.
+	const size_t samples = guide.nSamples();
+	const size_t guideBytes = samples * ( guide.compact() ? 1 : sizeof( double ) ) + 6 * sizeof( double );
+	size_t pixelBytes = std::min( guide.channels(), 3 ) * ( guideBytes + 2 * samples * sizeof( double ) );
+	if( &guide != &set )
+	{
+		pixelBytes += set.channels() * ( samples * ( set.compact() ? 1 : sizeof( double ) ) + 6 * sizeof( double ) );
+	}
+
+	// Use the largest tile whose samples, along with those in the halo of the kernel
+	// around it, fit in half of the L2 cache to leave room for everything else.
+	long cacheSize = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+	cacheSize = sysconf( _SC_LEVEL2_CACHE_SIZE );
+#endif
+	if( cacheSize <= 0 )
+	{
+		cacheSize = 256 * 1024;
+	}
+
+	const int kernelRadius = opt.kernelWidth > 1 ? ( opt.kernelWidth - 1 ) / 2 : 0;
+	int tileSize = 8;
+	while( tileSize < 256 )
+	{
+		size_t span = tileSize + 8 + 2 * kernelRadius;
+		if( span * span * pixelBytes > size_t( cacheSize / 2 ) )
+		{
+			break;
+		}
+		tileSize += 8;
+	}
+	return tileSize;
+}
+
+void tileOrder( int tilesX, int tilesY, int order, std::vector< int > &tiles )
+{
+	tiles.clear();
+	tiles.reserve( tilesX * tilesY );
+	if( order == Options::kRaster )
+	{
+		for( int i = 0; i < tilesX * tilesY; ++i )
+		{
+			tiles.push_back( i );
+		}
+		return;
+	}
+
+	int n = 1;
+	while( n < tilesX || n < tilesY )
+	{
+		n *= 2;
+	}
+
+	// Walk every cell of the enclosing power of two square and keep those inside the image.
+	for( int d = 0; d < n * n; ++d )
+	{
+		int x = 0, y = 0;
+		if( order == Options::kZOrder )
+		{
+			for( int bit = 0; ( 1 << bit ) < n; ++bit )
+			{
+				x |= ( ( d >> ( 2 * bit ) ) & 1 ) << bit;
+				y |= ( ( d >> ( 2 * bit + 1 ) ) & 1 ) << bit;
+			}
+		}
+		else
+		{
+			int t = d;
+			for( int s = 1; s < n; s *= 2 )
+			{
+				int rx = 1 & ( t / 2 );
+				int ry = 1 & ( t ^ rx );
+				if( ry == 0 )
+				{
+					if( rx == 1 )
+					{
+						x = s - 1 - x;
+						y = s - 1 - y;
+					}
+					std::swap( x, y );
+				}
+				x += s * rx;
+				y += s * ry;
+				t /= 4;
+			}
+		}
+
+		if( x < tilesX && y < tilesY )
+		{
+			tiles.push_back( y * tilesX + x );
+		}
+	}
+}
+
+int filterThreads( const Options &opt )
+{
+	if( opt.threads > 0 )
+	{
+		return opt.threads;
+	}
+	return std::max( int( std::thread::hardware_concurrency() ), 1 );
+}
+
+void filter( const SampleSet &set, const Options &opt, Image &result, bool showProgress )
+{
+	filter( set, set, opt, result, showProgress );
+}
+
+void filter( const SampleSet &guide, const SampleSet &set, const Options &opt, Image &result, bool showProgress )
+{
+	SourceTerms terms( guide );
+	filter( guide, terms, set, opt, result, showProgress );
+}
+
+void filter( const SampleSet &guide, const SourceTerms &terms, const SampleSet &set, const Options &opt, Image &result, bool showProgress )
+{
+	FilterControl control;
+	control.showProgress = showProgress;
+	filter( guide, terms, set, opt, result, control );
+}
+
+bool filter( const SampleSet &guide, const SourceTerms &terms, const SampleSet &set, const Options &opt, Image &result, const FilterControl &control )
+{
+	if( guide.width() != set.width() || guide.height() != set.height() || guide.nSamples() != set.nSamples() )
+	{
+		throw std::runtime_error( "The guide and the sample set do not match." );
+	}
+
+	const int width = set.width(), height = set.height();
+	if( control.mask && ( int( control.mask->size() ) != width * height || result.width() != width || result.height() != height || result.channels() != set.channels() ) )
+	{
+		throw std::runtime_error( "A masked filter needs a mask and a result which match the sample set." );
+	}
+	result.resize( width, height, set.channels() );
+	const unsigned char *mask = control.mask ? &( *control.mask )[0] : 0;
+
+	const int kernelRadius = opt.kernelWidth > 1 ? ( opt.kernelWidth - 1 ) / 2 : 0;
+	const int minRadius = opt.minKernelWidth > 0 ? std::min( std::max( ( opt.minKernelWidth - 1 ) / 2, 1 ), kernelRadius ) : kernelRadius;
+
+	// A gaussian falloff that weights contributing samples which are closer to the pixel being filtered higher.
+	// It only depends on the offset within the kernel so it is computed once up front for each kernel radius in use.
+	/// \todo Intuitive falloff parameters need to be added to the distance weight or at least a suitable curve found.
+	std::vector< std::vector< double > > distanceWeights( kernelRadius + 1 );
+	for( int radius = minRadius; radius <= kernelRadius; ++radius )
+	{
+		const int kernelWidth = radius * 2 + 1;
+		distanceWeights[radius].resize( kernelWidth * kernelWidth );
+		for( int ky = -radius; ky <= radius; ++ky )
+		{
+			for( int kx = -radius; kx <= radius; ++kx )
+			{
+				distanceWeights[radius][ ( ky + radius ) * kernelWidth + kx + radius ] = gaussian( sqrt( kx*kx + ky*ky ) / sqrt( radius*radius + radius*radius ), 0., .7, false );
+			}
+		}
+	}
+
+	std::vector< unsigned short > radii;
+	if( minRadius < kernelRadius )
+	{
+		if( kernelRadius > std::numeric_limits< unsigned short >::max() )
+		{
+			throw std::runtime_error( "The kernel is too wide for adaptive kernel widths." );
+		}
+		kernelRadii( guide, opt, minRadius, kernelRadius, radii );
+	}
+
+	// The image is split into tiles which the threads take in turn until there are none left.
+	const int tileSize = filterTileSize( guide, set, opt );
+	const int tilesX = ( width + tileSize - 1 ) / tileSize;
+	const int tilesY = ( height + tileSize - 1 ) / tileSize;
+	std::vector< int > tiles;
+	tileOrder( tilesX, tilesY, opt.tileOrder, tiles );
+	const int nTiles = int( tiles.size() );
+	const int nThreads = std::min( filterThreads( opt ), nTiles );
+
+	if( !radii.empty() )
+	{
+		// The cost of a pixel grows with the area of its kernel so the tiles differ in cost. Starting
+		// the most expensive ones first stops a thread from being left with a slow tile at the end.
+		const int nGuides = guideChannels( guide );
+		const double fullArea = ( 2 * kernelRadius + 1 ) * ( 2 * kernelRadius + 1 );
+		std::vector< double > tileCosts( tilesX * tilesY, 0. );
+		double cost = 0., fullCost = 0.;
+		for( int y = 0; y < height; ++y )
+		{
+			for( int x = 0; x < width; ++x )
+			{
+				if( mask && !mask[ y * width + x ] )
+				{
+					continue;
+				}
+				for( int c = 0; c < nGuides; ++c )
+				{
+					const int radius = radii[ ( y * width + x ) * nGuides + c ];
+					tileCosts[ ( y / tileSize ) * tilesX + x / tileSize ] += ( 2 * radius + 1 ) * ( 2 * radius + 1 );
+					fullCost += fullArea;
+				}
+			}
+		}
+		for( unsigned int i = 0; i < tileCosts.size(); ++i )
+		{
+			cost += tileCosts[i];
+		}
+
+		if( nThreads > 1 )
+		{
+			std::stable_sort( tiles.begin(), tiles.end(), [&tileCosts]( int a, int b ) { return tileCosts[a] > tileCosts[b]; } );
+		}
+
+		if( control.showProgress )
+		{
+			fprintf( stderr, "Adaptive kernel widths from %d to %d take %.1f%% of the work of the full kernel.\n", minRadius * 2 + 1, kernelRadius * 2 + 1, fullCost > 0. ? 100. * cost / fullCost : 100. );
+		}
+	}
+
+	std::atomic< int > nextTile( 0 ), tilesDone( 0 );
+	std::atomic< bool > expired( false );
+
+	std::mutex rejectionMutex;
+	RejectionStats rejection;
+
+	auto worker = [&]( bool reportProgress )
+	{
+		RejectionStats tileRejection;
+		for( int next = nextTile++; next < nTiles; next = nextTile++ )
+		{
+			if( expired || std::chrono::steady_clock::now() >= control.deadline )
+			{
+				expired = true;
+				break;
+			}
+
+			const int tile = tiles[next];
+			const int x0 = ( tile % tilesX ) * tileSize;
+			const int y0 = ( tile / tilesX ) * tileSize;
+			const int x1 = std::min( x0 + tileSize, width ), y1 = std::min( y0 + tileSize, height );
+			if( filterTile( guide, terms, set, opt, distanceWeights, kernelRadius, radii.empty() ? 0 : &radii[0], x0, y0, x1, y1, mask, result, tileRejection ) > 0 && control.tileDone )
+			{
+				control.tileDone( x0, y0, x1, y1 );
+			}
+
+			int done = ++tilesDone;
+			if( reportProgress )
+			{
+				fprintf( stderr, "\rFiltering %5.2f%% complete.", 100. * done / nTiles );
+			}
+		}
+
+		std::lock_guard< std::mutex > lock( rejectionMutex );
+		rejection.add( tileRejection );
+	};
+
+	std::vector< std::thread > threads;
+	for( int i = 1; i < nThreads; ++i )
+	{
+		threads.push_back( std::thread( worker, false ) );
+	}
+	worker( control.showProgress );
+	for( unsigned int i = 0; i < threads.size(); ++i )
+	{
+		threads[i].join();
+	}
+
+	if( control.showProgress )
+	{
+		fprintf( stderr, "\rFiltering %5.2f%% complete.\n", 100. * tilesDone / nTiles );
+	}
+
+	if( control.showProgress && opt.rejectEpsilon > 0. && rejection.pixels > 0 )
+	{
+		// The error bounds are relative to the largest difference between a sample and the mean of a pixel.
+		double lowest = std::numeric_limits< double >::max(), highest = -std::numeric_limits< double >::max();
+		for( int y = 0; y < height; ++y )
+		{
+			for( int x = 0; x < width; ++x )
+			{
+				for( int c = 0; c < set.channels(); ++c )
+				{
+					lowest = std::min( lowest, set.min( x, y, c ) );
+					highest = std::max( highest, set.max( x, y, c ) );
+				}
+			}
+		}
+		const double range = std::max( highest - lowest, 0. );
+		const double samples = double( std::max( rejection.samples, 1LL ) );
+		fprintf( stderr, "Early rejection skipped %.1f%% of the neighbours and %.1f%% of the samples. %lld of %lld pixel channels were filtered exactly.\n",
+			100. * rejection.skippedNeighbours / std::max( rejection.neighbours, 1LL ), 100. * rejection.skippedSamples / samples, rejection.exactPixels, rejection.pixels );
+		fprintf( stderr, "Filtering them again evaluated %.1f%% of the samples twice, for a net saving of %.1f%% of the sample evaluations.\n",
+			100. * rejection.wastedSamples / samples, 100. * ( rejection.skippedSamples - rejection.wastedSamples ) / samples );
+		fprintf( stderr, "The result is within %g of the exact result, and %g on average.\n", rejection.maxError * range, rejection.sumError * range / rejection.pixels );
+	}
+
+	return !expired;
+}
+
+std::unique_ptr< SampleSet > weightGuideSet( const std::vector< const Image* > &images, const Options &opt )
+{
+	std::unique_ptr< SampleSet > guide;
+	if( opt.weightMode != Options::kPerChannel )
+	{
+		std::vector< Image > guides( images.size() );
+		for( unsigned int i = 0; i < images.size(); ++i )
+		{
+			weightGuide( *images[i], opt, guides[i] );
+		}
+		guide.reset( new SampleSet( guides ) );
+	}
+	return guide;
+}
+
+void denoise( const std::vector< const Image* > &images, const Options &opt, Image &result, bool showProgress )
+{
+	if( opt.chromaScale > 0 )
+	{
+		denoiseLumaChroma( images, opt, result, showProgress );
+		return;
+	}
+
+	SampleSet set( images, opt.compactSamples );
+	if( showProgress && opt.compactSamples )
+	{
+		fprintf( stderr, set.compact() ? "Stored the samples as 8 bit codes in %.1fMB.\n" : "The inputs aren't 8 bit images so the samples are stored as doubles in %.1fMB.\n", set.sampleBytes() / ( 1024. * 1024. ) );
+	}
+
+	std::unique_ptr< SampleSet > guide = weightGuideSet( images, opt );
+	filter( guide ? *guide : set, set, opt, result, showProgress );
+}
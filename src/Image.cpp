@@ -37,53 +37,108 @@
 #include <algorithm>
 #include <stdexcept>
 #include <fstream>
+#include <thread>
+#include <stdint.h>
+#include <string.h>
 
 #include "Image.h"
 
-Image::Image( int w, int h )
+Image::Image( int w, int h, int channels )
 {
-	resize( w, h );
+	resize( w, h, channels );
 }
 
 const double* Image::readable( int x, int y ) const
 {
 	x = std::max( std::min( x, m_width - 1 ), 0 );
 	y = std::max( std::min( y, m_height - 1 ), 0 );
-	return &m_data[ ( x + m_width * y ) * 3 ];
+	return &m_data[ ( x + m_width * y ) * m_channels ];
 }
 
 double* Image::writeable( int x, int y )
 {
-	return &m_data[ ( x + m_width * y ) * 3 ];
+	return &m_data[ ( x + m_width * y ) * m_channels ];
 }
 
 const double* Image::at( int x, int y ) const
 {
-	return &m_data[ ( x + m_width * y ) * 3 ];
+	return &m_data[ ( x + m_width * y ) * m_channels ];
 }
 
-SampleSet::SampleSet( const std::vector< Image > &images ) :
+SampleSet::SampleSet( const std::vector< Image > &images, bool compact ) :
 	m_width(0),
-	m_height(0)
+	m_height(0),
+	m_channels(0),
+	m_nSamples(0)
+{
+	std::vector< const Image* > pointers( images.size() );
+	for( unsigned int j = 0; j < images.size(); ++j )
+	{
+		pointers[j] = &images[j];
+	}
+	init( pointers, compact );
+}
+
+SampleSet::SampleSet( const std::vector< const Image* > &images, bool compact ) :
+	m_width(0),
+	m_height(0),
+	m_channels(0),
+	m_nSamples(0)
+{
+	init( images, compact );
+}
+
+void SampleSet::init( const std::vector< const Image* > &images, bool compact )
 {
 	for( unsigned int j = 0; j < images.size(); ++j )
 	{
 		if( m_width == 0 && m_height == 0 )
 		{
-			m_width = images[j].width();
-			m_height = images[j].height();
+			m_width = images[j]->width();
+			m_height = images[j]->height();
+			m_channels = images[j]->channels();
 		}
 		else
 		{
-			if( m_width != images[j].width() || m_height != images[j].height() )
+			if( m_width != images[j]->width() || m_height != images[j]->height() )
 			{
 				throw std::runtime_error( "Not all images are the same size." );
 			}
+			if( m_channels != images[j]->channels() )
+			{
+				throw std::runtime_error( "Not all images have the same number of channels." );
+			}
+		}
+	}
+	const int arraySize = m_width * m_height * m_channels;	
+	m_nSamples = int( images.size() );
+
+	// The samples can only be stored as codes if every one of them is exactly
+	// one of the values in the gamma table.
+	const double *table = gamma22Table();
+	for( unsigned int i = 0; compact && i < images.size(); ++i )
+	{
+		const double *values = images[i]->at( 0, 0 );
+		for( int j = 0; j < arraySize; ++j )
+		{
+			if( table[ fromGamma22( values[j] ) ] != values[j] && values[j] != 0. )
+			{
+				compact = false;
+				break;
+			}
 		}
 	}
-	m_samples.resize( m_width * m_height * 3 );
 
-	const int arraySize = m_width * m_height * 3;	
+	if( compact )
+	{
+		m_codes.resize( size_t( arraySize ) * m_nSamples );
+		m_fill.resize( arraySize );
+	}
+	else
+	{
+		m_samples.resize( size_t( arraySize ) * m_nSamples );
+	}
+
 	m_mean.resize( arraySize );
 	m_median.resize( arraySize );
 	m_variance.resize( arraySize );
@@ -91,114 +146,393 @@ SampleSet::SampleSet( const std::vector< Image > &images ) :
 	m_min.resize( arraySize );
 	m_max.resize( arraySize );
 
-	int index = 0;
 	std::vector<double> s;
 	for( int y = 0; y < m_height; ++y )
 	{
 		for( int x = 0; x < m_width; ++x )
 		{
-			for( int c = 0; c < 3; ++c, ++index )
+			initPixel( images, x, y, s );
+		}
+	}
+}
+
+void SampleSet::initPixel( const std::vector< const Image* > &images, int x, int y, std::vector< double > &s )
+{
+	const bool compact = !m_codes.empty();
+	int index = arrayIndex( x, y, 0 );
+	for( int c = 0; c < m_channels; ++c, ++index )
+	{
+		s.resize( images.size() );
+		for( unsigned int i = 0; i < images.size(); ++i )
+		{
+			s[i] = images[i]->at( x, y )[c];
+		}
+	
+		double mean = 0., variance = 0., norm = 1. / s.size();
+		double max = std::numeric_limits<double>::min();
+		double min = std::numeric_limits<double>::max();
+
+		double areBlack = true;
+		for( unsigned int i = 0; i < s.size(); ++i )
+		{
+			if( s[i] != 0. )
 			{
-				s.resize( images.size() );
-				for( unsigned int i = 0; i < images.size(); ++i )
+				areBlack = false;
+				break;
+			}
+		}
+		
+		if( !areBlack )
+		{
+			bool hasAnyBlack = false;
+			double count = 0.;
+			for( unsigned int i = 0; i < s.size(); ++i )
+			{
+				if( s[i] == 0. )
 				{
-					s[i] = images[i].at( x, y )[c];
+					hasAnyBlack = true;
+					continue;
 				}
-			
-				double mean = 0., variance = 0., norm = 1. / s.size();
-				double max = std::numeric_limits<double>::min();
-				double min = std::numeric_limits<double>::max();
 
-				double areBlack = true;
+				++count;
+
+				min = ( s[i] < min ) ? s[i] : min;
+				max = ( s[i] > max ) ? s[i] : max;
+				mean += s[i];
+			}
+			mean /= count;
+
+			if( hasAnyBlack )
+			{
 				for( unsigned int i = 0; i < s.size(); ++i )
 				{
-					if( s[i] != 0. )
+					if( s[i] == 0. )
 					{
-						areBlack = false;
-						break;
+						continue;
 					}
+					double d = s[i] - mean;
+					variance += d*d*( 1. / count );
 				}
-				
-				if( !areBlack )
+			
+				bool flipFlop = false;
+				double newMean = 0.;
+				variance = 0.;
+				for( unsigned int i = 0; i < s.size(); ++i )
 				{
-					bool hasAnyBlack = false;
-					double count = 0.;
-					for( unsigned int i = 0; i < s.size(); ++i )
-					{
-						if( s[i] == 0. )
-						{
-							hasAnyBlack = true;
-							continue;
-						}
-
-						++count;
-
-						min = ( s[i] < min ) ? s[i] : min;
-						max = ( s[i] > max ) ? s[i] : max;
-						mean += s[i];
-					}
-					mean /= count;
-
-					if( hasAnyBlack )
-					{
-						for( unsigned int i = 0; i < s.size(); ++i )
-						{
-							if( s[i] == 0. )
-							{
-								continue;
-							}
-							double d = s[i] - mean;
-							variance += d*d*( 1. / count );
-						}
-					
-						bool flipFlop = false;
-						double newMean = 0.;
-						variance = 0.;
-						for( unsigned int i = 0; i < s.size(); ++i )
-						{
-							if( s[i] == 0. )
-							{
-								s[i] = mean;
-								newMean += mean * norm;
-							}
-							double d = s[i] - mean;
-							variance += d*d*norm;
-						}
-						mean = newMean;
-					}
-					else
+					if( s[i] == 0. )
 					{
-						for( unsigned int i = 0; i < s.size(); ++i )
-						{
-							double d = s[i] - mean;
-							variance += d*d*norm;
-						}
+						s[i] = mean;
+						newMean += mean * norm;
 					}
+					double d = s[i] - mean;
+					variance += d*d*norm;
 				}
-				else
+				mean = newMean;
+			}
+			else
+			{
+				for( unsigned int i = 0; i < s.size(); ++i )
 				{
-					min = max = mean = variance = 0.;
+					double d = s[i] - mean;
+					variance += d*d*norm;
 				}
-				
-				m_min[index] = min;
-				m_max[index] = max;
-				m_mean[index] = mean;
-				m_variance[index] = variance;
-				m_deviation[index] = sqrt( variance );
-				m_samples[index] = s;
-				
-				std::sort( s.begin(), s.end() );
-				if( s.size() > 2 )
+			}
+		}
+		else
+		{
+			min = max = mean = variance = 0.;
+		}
+		
+		m_min[index] = min;
+		m_max[index] = max;
+		m_mean[index] = mean;
+		m_variance[index] = variance;
+		m_deviation[index] = sqrt( variance );
+		if( compact )
+		{
+			m_fill[index] = 0.;
+			for( unsigned int i = 0; i < s.size(); ++i )
+			{
+				const double value = images[i]->at( x, y )[c];
+				if( value == 0. )
 				{
-					m_median[index] = s[ std::min( int( s.size()-1 ), std::max( int( ceil( s.size() / 2. ) ), 0 ) ) ];
+					m_codes[ size_t( index ) * m_nSamples + i ] = 0;
+					m_fill[index] = s[i];
 				}
 				else
 				{
-					m_median[index] = s.front() + ( s.back() - s.front() ) / 2.;
+					m_codes[ size_t( index ) * m_nSamples + i ] = (unsigned char)fromGamma22( value );
+				}
+			}
+		}
+		else
+		{
+			std::copy( s.begin(), s.end(), m_samples.begin() + size_t( index ) * m_nSamples );
+		}
+		
+		std::sort( s.begin(), s.end() );
+		if( s.size() > 2 )
+		{
+			m_median[index] = s[ std::min( int( s.size()-1 ), std::max( int( ceil( s.size() / 2. ) ), 0 ) ) ];
+		}
+		else
+		{
+			m_median[index] = s.front() + ( s.back() - s.front() ) / 2.;
+		}
+	}
+}
+
+bool SampleSet::update( const std::vector< const Image* > &images, const std::vector< unsigned char > &changed )
+{
+	if( int( images.size() ) != m_nSamples || int( changed.size() ) != m_width * m_height )
+	{
+		throw std::runtime_error( "The images don't match the sample set." );
+	}
+	for( unsigned int i = 0; i < images.size(); ++i )
+	{
+		if( images[i]->width() != m_width || images[i]->height() != m_height || images[i]->channels() != m_channels )
+		{
+			throw std::runtime_error( "The images don't match the sample set." );
+		}
+	}
+
+	// Codes can only be stored for the values in the gamma table.
+	const double *table = gamma22Table();
+	for( int p = 0; compact() && p < m_width * m_height; ++p )
+	{
+		for( unsigned int i = 0; changed[p] && i < images.size(); ++i )
+		{
+			const double *values = images[i]->at( p % m_width, p / m_width );
+			for( int c = 0; c < m_channels; ++c )
+			{
+				if( table[ fromGamma22( values[c] ) ] != values[c] && values[c] != 0. )
+				{
+					return false;
 				}
 			}
 		}
 	}
+
+	std::vector<double> s;
+	for( int p = 0; p < m_width * m_height; ++p )
+	{
+		if( changed[p] )
+		{
+			initPixel( images, p % m_width, p / m_width, s );
+		}
+	}
+	return true;
+}
+
+void stackLayers( const std::vector< const Image* > &layers, Image &stacked )
+{
+	int channels = 0;
+	for( unsigned int i = 0; i < layers.size(); ++i )
+	{
+		if( layers[i]->width() != layers[0]->width() || layers[i]->height() != layers[0]->height() )
+		{
+			throw std::runtime_error( "Not all layers are the same size." );
+		}
+		channels += layers[i]->channels();
+	}
+
+	stacked.resize( layers[0]->width(), layers[0]->height(), channels );
+	for( int y = 0; y < stacked.height(); ++y )
+	{
+		for( int x = 0; x < stacked.width(); ++x )
+		{
+			double *out = stacked.writeable( x, y );
+			for( unsigned int i = 0; i < layers.size(); ++i )
+			{
+				const double *in = layers[i]->at( x, y );
+				out = std::copy( in, in + layers[i]->channels(), out );
+			}
+		}
+	}
+}
+
+void extractLayer( const Image &stacked, int firstChannel, int nChannels, Image &layer )
+{
+	if( firstChannel < 0 || firstChannel + nChannels > stacked.channels() )
+	{
+		throw std::runtime_error( "The layer is outside of the image's channels." );
+	}
+
+	layer.resize( stacked.width(), stacked.height(), nChannels );
+	for( int y = 0; y < stacked.height(); ++y )
+	{
+		for( int x = 0; x < stacked.width(); ++x )
+		{
+			const double *in = stacked.at( x, y ) + firstChannel;
+			std::copy( in, in + nChannels, layer.writeable( x, y ) );
+		}
+	}
+}
+
+double psnr( const Image &a, const Image &b )
+{
+	if( a.width() != b.width() || a.height() != b.height() )
+	{
+		throw std::runtime_error( "Cannot compare images of different sizes." );
+	}
+	if( a.channels() < 3 || b.channels() < 3 )
+	{
+		throw std::runtime_error( "Cannot compare images with fewer than three channels." );
+	}
+
+	double error = 0.;
+	for( int y = 0; y < a.height(); ++y )
+	{
+		for( int x = 0; x < a.width(); ++x )
+		{
+			for( int c = 0; c < 3; ++c )
+			{
+				double d = fromGamma22( a.at( x, y )[c] ) - fromGamma22( b.at( x, y )[c] );
+				error += d * d;
+			}
+		}
+	}
+	error /= a.width() * a.height() * 3.;
+
+	return error == 0. ? std::numeric_limits<double>::infinity() : 10. * log10( 255. * 255. / error );
+}
+
+namespace
+{
+
+inline bool isDigit( char c )
+{
+	return (unsigned char)( c - '0' ) < 10;
+}
+
+inline bool isSpace( char c )
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+/// Returns the number of whitespace separated values in [begin, end).
+size_t countValues( const char *begin, const char *end )
+{
+	size_t count = 0;
+	bool inValue = false;
+	for( const char *c = begin; c < end; ++c )
+	{
+		bool digit = isDigit( *c );
+		count += digit && !inValue;
+		inValue = digit;
+	}
+	return count;
+}
+
+/// Parses the values in [begin, end) and writes table[value] to out[first], out[first+1], ...
+/// stopping once out[count-1] has been written. Returns false if anything other than
+/// whitespace and values in the range 0-255 is found.
+bool decodeValues( const char *begin, const char *end, const double *table, double *out, size_t first, size_t count )
+{
+	const char *c = begin;
+	while( c < end && first < count )
+	{
+		if( isSpace( *c ) )
+		{
+			++c;
+			continue;
+		}
+
+		int value = 0;
+		const char *start = c;
+		while( c < end && isDigit( *c ) && c - start < 4 )
+		{
+			value = value * 10 + ( *c++ - '0' );
+		}
+
+		if( c == start || value > 255 || ( c < end && !isSpace( *c ) ) )
+		{
+			return false;
+		}
+
+		out[ first++ ] = table[ value ];
+	}
+	return true;
+}
+
+/// Decodes the first count values of the ASCII data into out. The data is split into
+/// chunks at whitespace which are counted in parallel to find the index of each chunk's
+/// first value, and then parsed in parallel.
+bool parseValues( const std::vector< char > &data, const double *table, double *out, size_t count )
+{
+	const size_t minChunk = 1 << 20;
+	const int nChunks = int( std::max( size_t( 1 ), std::min( size_t( std::max( std::thread::hardware_concurrency(), 1u ) ), data.size() / minChunk ) ) );
+
+	std::vector< const char* > bounds( nChunks + 1 );
+	const char *begin = data.empty() ? 0 : &data[0];
+	const char *end = begin + data.size();
+	bounds[0] = begin;
+	bounds[nChunks] = end;
+	for( int i = 1; i < nChunks; ++i )
+	{
+		// Move the boundary forward until it is no longer part way through a value.
+		const char *c = std::max( begin + data.size() * i / nChunks, bounds[i-1] );
+		while( c < end && isDigit( *c ) )
+		{
+			++c;
+		}
+		bounds[i] = c;
+	}
+
+	std::vector< size_t > firsts( nChunks + 1, 0 );
+	std::vector< char > ok( nChunks, 1 );
+	std::vector< std::thread > threads;
+
+	for( int i = 0; i < nChunks; ++i )
+	{
+		threads.push_back( std::thread( [&, i]() { firsts[i+1] = countValues( bounds[i], bounds[i+1] ); } ) );
+	}
+	for( unsigned int i = 0; i < threads.size(); ++i )
+	{
+		threads[i].join();
+	}
+
+	for( int i = 0; i < nChunks; ++i )
+	{
+		firsts[i+1] += firsts[i];
+	}
+	if( firsts[nChunks] < count )
+	{
+		return false;
+	}
+
+	threads.clear();
+	for( int i = 0; i < nChunks; ++i )
+	{
+		threads.push_back( std::thread( [&, i]() { ok[i] = decodeValues( bounds[i], bounds[i+1], table, out, firsts[i], count ); } ) );
+	}
+	for( unsigned int i = 0; i < threads.size(); ++i )
+	{
+		threads[i].join();
+	}
+
+	return std::find( ok.begin(), ok.end(), 0 ) == ok.end();
+}
+
+} // namespace
+
+const double *gamma22Table()
+{
+	struct Table
+	{
+		Table()
+		{
+			for( int i = 0; i < 256; ++i )
+			{
+				values[i] = toGamma22( i );
+			}
+		}
+
+		double values[256];
+	};
+
+	static const Table table;
+	return table.values;
 }
 
 bool readPPM( const std::string &path, Image &image )
@@ -229,31 +563,146 @@ bool readPPM( const std::string &path, Image &image )
 		throw std::runtime_error( "Failed to read the format or it is not correct." );
 	}
 
-	image.resize( width, height );
-	int pixel[3];
-	for( int y = 0; y < image.height(); ++y )
+	// Read the rest of the file in one go and parse it in chunks on several threads.
+	std::vector< char > data;
+	char buffer[65536];
+	size_t read;
+	while( ( read = fread( buffer, 1, sizeof( buffer ), f ) ) > 0 )
+	{
+		data.insert( data.end(), buffer, buffer + read );
+	}
+	fclose(f);
+
+	image.resize( width, height, 3 );
+	if( !parseValues( data, gamma22Table(), image.writeable( 0, 0 ), size_t( width ) * height * 3 ) )
 	{
-		for( int x = 0; x < image.width(); ++x )
+		throw std::runtime_error( "Failed to read the image data." );
+	}
+
+	return 1;
+}
+
+namespace
+{
+
+/// The reference encoding used by the BMP writer. Note that it truncates rather than
+/// rounds and that, unlike fromGamma22(), the power is evaluated with a float exponent.
+inline unsigned char bmpGamma( double x )
+{
+	const float invGamma = 1.f / 2.2f;
+	float gamma = pow( x, invGamma ) * 255.f;
+	return (unsigned char)( std::min( 255.f, std::max( 0.f, gamma ) ) );
+}
+
+inline unsigned char ppmGamma( double x )
+{
+	return (unsigned char)fromGamma22( x );
+}
+
+/// The smallest input that each of the 256 output codes of a monotonic 8 bit encoding
+/// is produced for. Encoding then only needs eight comparisons against the table rather
+/// than a pow(), and as the thresholds are found by bisecting the reference encoding
+/// over every double in the range the results are exactly those of the reference.
+struct GammaEncoder
+{
+	GammaEncoder( unsigned char (*reference)( double ) )
+	{
+		thresholds[0] = -std::numeric_limits<double>::infinity();
+		for( int v = 1; v < 256; ++v )
 		{
-			bytes = fscanf( f, "%d %d %d ", &pixel[0], &pixel[1], &pixel[2] );
-			if( bytes != 3 )
+			// Non-negative doubles have the same order as their bit patterns, so the
+			// bisection is done on the bits to find the exact boundary.
+			uint64_t lo = bits( 0. ), hi = bits( 2. );
+			if( reference( fromBits( hi ) ) < v )
+			{
+				thresholds[v] = std::numeric_limits<double>::infinity();
+				continue;
+			}
+			while( lo < hi )
 			{
-				throw std::runtime_error( "Failed to read the image data." );
+				uint64_t mid = lo + ( hi - lo ) / 2;
+				if( reference( fromBits( mid ) ) >= v )
+				{
+					hi = mid;
+				}
+				else
+				{
+					lo = mid + 1;
+				}
 			}
+			thresholds[v] = fromBits( lo );
 
-			double *inPixel = image.writeable( x, y );
-			inPixel[0] = toGamma22( pixel[0] );
-			inPixel[1] = toGamma22( pixel[1] );
-			inPixel[2] = toGamma22( pixel[2] );
+			if( reference( thresholds[v] ) < v || ( lo > 0 && reference( fromBits( lo - 1 ) ) >= v ) )
+			{
+				throw std::runtime_error( "The gamma encoding is not monotonic." );
+			}
 		}
 	}
 
-	fclose(f);
-	return 1;
+	/// A branchless binary search which returns 0 for NaN and negative values.
+	inline unsigned char operator()( double x ) const
+	{
+		int v = 0;
+		v += x >= thresholds[ v + 128 ] ? 128 : 0;
+		v += x >= thresholds[ v + 64 ] ? 64 : 0;
+		v += x >= thresholds[ v + 32 ] ? 32 : 0;
+		v += x >= thresholds[ v + 16 ] ? 16 : 0;
+		v += x >= thresholds[ v + 8 ] ? 8 : 0;
+		v += x >= thresholds[ v + 4 ] ? 4 : 0;
+		v += x >= thresholds[ v + 2 ] ? 2 : 0;
+		v += x >= thresholds[ v + 1 ] ? 1 : 0;
+		return (unsigned char)v;
+	}
+
+	static inline uint64_t bits( double x ) { uint64_t b; memcpy( &b, &x, sizeof( b ) ); return b; }
+	static inline double fromBits( uint64_t b ) { double x; memcpy( &x, &b, sizeof( x ) ); return x; }
+
+	double thresholds[256];
+};
+
+const GammaEncoder &ppmEncoder()
+{
+	static const GammaEncoder encoder( ppmGamma );
+	return encoder;
+}
+
+const GammaEncoder &bmpEncoder()
+{
+	static const GammaEncoder encoder( bmpGamma );
+	return encoder;
+}
+
+/// Encodes a row of pixels to 8 bits per channel in the given channel order.
+inline void encodeRow( const GammaEncoder &encoder, const Image &image, int y, const int order[3], unsigned char *out )
+{
+	const double *pixel = image.at( 0, y );
+	const int channels = image.channels();
+	for( int x = 0; x < image.width(); ++x, pixel += channels, out += 3 )
+	{
+		out[0] = encoder( pixel[ order[0] ] );
+		out[1] = encoder( pixel[ order[1] ] );
+		out[2] = encoder( pixel[ order[2] ] );
+	}
+}
+
+/// Writes are gathered into blocks of at least this many bytes.
+const size_t writeBlockSize = 1 << 20;
+
+} // namespace
+
+void encodeGamma22( const Image &image, int y, unsigned char *out )
+{
+	const int rgb[3] = { 0, 1, 2 };
+	encodeRow( ppmEncoder(), image, y, rgb, out );
 }
 
 bool writePPM( const std::string &path, const Image &image )
 {
+	if( image.channels() < 3 )
+	{
+		throw std::runtime_error( "Only images with at least three channels can be written." );
+	}
+
 	FILE *f = fopen( path.c_str(), "w"); // Write image to a PPM file.
 	if( !f )
 	{
@@ -261,30 +710,65 @@ bool writePPM( const std::string &path, const Image &image )
 	}
 
 	int bytes = fprintf( f, "P3\n%d %d\n%d\n", image.width(), image.height(), 255 );
-	if( bytes != 15 )
+	if( bytes <= 0 )
 	{
 		throw std::runtime_error( "Failed to write the image header." );
 	}
 
+	// The text of each value, including its trailing space.
+	struct ValueText
+	{
+		ValueText()
+		{
+			for( int v = 0; v < 256; ++v )
+			{
+				length[v] = sprintf( text[v], "%d ", v );
+			}
+		}
+
+		char text[256][5];
+		int length[256];
+	};
+	static const ValueText values;
+
+	std::vector< unsigned char > codes( image.width() * 3 );
+	std::vector< char > buffer;
+	buffer.reserve( writeBlockSize + codes.size() * 4 );
+	bool success = true;
 	for( int y = 0; y < image.height(); ++y )
 	{
-		for( int x = 0; x < image.width(); ++x )
+		encodeGamma22( image, y, &codes[0] );
+		for( unsigned int i = 0; i < codes.size(); ++i )
+		{
+			const char *text = values.text[ codes[i] ];
+			buffer.insert( buffer.end(), text, text + values.length[ codes[i] ] );
+		}
+
+		if( buffer.size() >= writeBlockSize || y == image.height() - 1 )
 		{
-			const double *pixel = image.at( x, y );
-			bytes = fprintf(f,"%d %d %d ", fromGamma22( pixel[0] ), fromGamma22( pixel[1] ), fromGamma22( pixel[2] ) );
+			success = success && fwrite( &buffer[0], 1, buffer.size(), f ) == buffer.size();
+			buffer.clear();
 		}
 	}
 
 	fclose(f);
-	return 1;
+	return success;
 }
 
 bool writeBMP( const std::string &path, const Image &image )
 {
+	if( image.channels() < 3 )
+	{
+		throw std::runtime_error( "Only images with at least three channels can be written." );
+	}
+
+	// Each row is padded to a multiple of 4 bytes.
+	const int rowSize = ( image.width() * 3 + 3 ) & ~3;
+
 	std::ofstream bmp( path.c_str(), std::ios::binary );
 	BmpHeader header;
 	bmp.write("BM", 2);
-	header.mFileSize   = ( unsigned int )( sizeof(BmpHeader) + 2 ) + image.width() * image.height() * 3;
+	header.mFileSize   = ( unsigned int )( sizeof(BmpHeader) + 2 ) + rowSize * image.height();
 	header.mReserved01 = 0;
 	header.mDataOffset = ( unsigned int )( sizeof(BmpHeader) + 2 );
 	header.mHeaderSize = 40;
@@ -293,7 +777,7 @@ bool writeBMP( const std::string &path, const Image &image )
 	header.mColorPlates     = 1;
 	header.mBitsPerPixel    = 24;
 	header.mCompression     = 0;
-	header.mImageSize       = image.width() * image.height() * 3;
+	header.mImageSize       = rowSize * image.height();
 	header.mHorizRes        = 2953;
 	header.mVertRes         = 2953;
 	header.mPaletteColors   = 0;
@@ -301,27 +785,19 @@ bool writeBMP( const std::string &path, const Image &image )
 
 	bmp.write((char*)&header, sizeof(header));
 
-	const float invGamma = 1.f / 2.2f;
+	const int bgr[3] = { 2, 1, 0 };
+	const int rowsPerBlock = std::max( int( writeBlockSize / rowSize ), 1 );
+	std::vector< unsigned char > buffer( rowSize * std::min( rowsPerBlock, image.height() ), 0 );
+	int row = 0;
 	for( int y = image.height()-1; y >= 0; --y )
 	{ 
-		for( int x = 0; x < image.width(); ++x )
+		// bmp is stored from bottom up
+		encodeRow( bmpEncoder(), image, y, bgr, &buffer[ row * rowSize ] );
+		if( ++row == rowsPerBlock || y == 0 )
 		{
-			// bmp is stored from bottom up
-			const double *pixel = image.at( x, y );
-			typedef unsigned char byte;
-			float gammaBgr[3];
-			gammaBgr[0] = pow( pixel[2], invGamma ) * 255.f;
-			gammaBgr[1] = pow( pixel[1], invGamma ) * 255.f;
-			gammaBgr[2] = pow( pixel[0], invGamma ) * 255.f;
-
-			byte bgrB[3];
-			bgrB[0] = byte( std::min( 255.f, std::max( 0.f, gammaBgr[0] ) ) );
-			bgrB[1] = byte( std::min( 255.f, std::max( 0.f, gammaBgr[1] ) ) );
-			bgrB[2] = byte( std::min( 255.f, std::max( 0.f, gammaBgr[2] ) ) );
-
-			bmp.write( (char*)&bgrB, sizeof( bgrB ) );
+			bmp.write( (char*)&buffer[0], row * rowSize );
+			row = 0;
 		}
 	}
-	return true;
+	return bool( bmp );
 }
-
@@ -0,0 +1,239 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+
+#include "Options.h"
+#include "Image.h"
+#include "Filter.h"
+#include "Incremental.h"
+
+namespace
+{
+
+/// Grows the marked pixels of the mask by radius in each direction, so that every pixel
+/// whose kernel covers a marked pixel is marked. The square is dilated a row and then a
+/// column at a time by tracking the distance to the last marked pixel in each direction.
+void dilate( int width, int height, int radius, std::vector< unsigned char > &mask )
+{
+	if( radius <= 0 )
+	{
+		return;
+	}
+
+	std::vector< unsigned char > rows( mask.size(), 0 );
+	for( int y = 0; y < height; ++y )
+	{
+		const unsigned char *in = &mask[ y * width ];
+		unsigned char *out = &rows[ y * width ];
+		for( int x = 0, last = -radius - 1; x < width; ++x )
+		{
+			last = in[x] ? x : last;
+			out[x] = x - last <= radius;
+		}
+		for( int x = width - 1, last = width + radius; x >= 0; --x )
+		{
+			last = in[x] ? x : last;
+			out[x] |= last - x <= radius;
+		}
+	}
+
+	for( int x = 0; x < width; ++x )
+	{
+		for( int y = 0, last = -radius - 1; y < height; ++y )
+		{
+			last = rows[ y * width + x ] ? y : last;
+			mask[ y * width + x ] = y - last <= radius;
+		}
+		for( int y = height - 1, last = height + radius; y >= 0; --y )
+		{
+			last = rows[ y * width + x ] ? y : last;
+			mask[ y * width + x ] |= last - y <= radius;
+		}
+	}
+}
+
+} // namespace
+
+IncrementalDenoiser::IncrementalDenoiser( const Options &opt ) :
+	m_opt( opt )
+{
+}
+
+void IncrementalDenoiser::denoise( const std::vector< const Image* > &frames, Image &result )
+{
+	m_frames.resize( frames.size() );
+	for( unsigned int i = 0; i < frames.size(); ++i )
+	{
+		m_frames[i] = *frames[i];
+	}
+
+	// The luma and chroma are filtered from sets which are built for each run, so there
+	// is no state to keep and every update filters the frames again from scratch.
+	if( m_opt.chromaScale > 0 )
+	{
+		m_set.reset();
+		::denoise( frames, m_opt, m_result );
+		result = m_result;
+		return;
+	}
+
+	m_set.reset( new SampleSet( frames, m_opt.compactSamples ) );
+	buildGuides( frames );
+	m_guide.reset( m_guides.empty() ? 0 : new SampleSet( guidePointers() ) );
+
+	const SampleSet &guide = m_guide ? *m_guide : *m_set;
+	m_terms.reset( new SourceTerms( guide ) );
+	filter( guide, *m_terms, *m_set, m_opt, m_result );
+	result = m_result;
+}
+
+int IncrementalDenoiser::update( const std::vector< const Image* > &frames, const std::vector< DirtyRect > &hints, Image &result )
+{
+	bool matches = !frames.empty() && frames.size() == m_frames.size();
+	for( unsigned int i = 0; matches && i < frames.size(); ++i )
+	{
+		matches = frames[i]->width() == m_frames[i].width() && frames[i]->height() == m_frames[i].height() && frames[i]->channels() == m_frames[i].channels();
+	}
+	if( !matches )
+	{
+		denoise( frames, result );
+		return result.width() * result.height();
+	}
+
+	const int width = m_frames[0].width(), height = m_frames[0].height();
+	std::vector< unsigned char > changed( width * height, 0 );
+	if( hints.empty() )
+	{
+		diff( frames, changed );
+	}
+	else
+	{
+		for( unsigned int r = 0; r < hints.size(); ++r )
+		{
+			const int x0 = std::min( std::max( hints[r].x, 0 ), width ), x1 = std::min( hints[r].x + hints[r].width, width );
+			const int y0 = std::min( std::max( hints[r].y, 0 ), height ), y1 = std::min( hints[r].y + hints[r].height, height );
+			for( int y = y0; y < y1; ++y )
+			{
+				std::fill( changed.begin() + y * width + x0, changed.begin() + y * width + std::max( x1, x0 ), 1 );
+			}
+		}
+	}
+
+	if( std::find( changed.begin(), changed.end(), 1 ) == changed.end() )
+	{
+		result = m_result;
+		return 0;
+	}
+
+	if( !m_set )
+	{
+		denoise( frames, result );
+		return width * height;
+	}
+
+	for( unsigned int i = 0; i < frames.size(); ++i )
+	{
+		m_frames[i] = *frames[i];
+	}
+
+	// Only the statistics of the changed pixels depend on the new samples. A compact set can't
+	// store samples which aren't 8 bit codes, so it is built again, but as the unchanged pixels
+	// get the same values the result of the previous run still holds for them.
+	if( !m_set->update( frames, changed ) )
+	{
+		m_set.reset( new SampleSet( frames, m_opt.compactSamples ) );
+	}
+	if( m_guide )
+	{
+		buildGuides( frames );
+		m_guide->update( guidePointers(), changed );
+	}
+	const SampleSet &guide = m_guide ? *m_guide : *m_set;
+	m_terms->update( guide, changed );
+
+	// A pixel's result only depends on the pixels under its kernel, so only those within the
+	// kernel's radius of a change need to be filtered again.
+	dilate( width, height, m_opt.kernelWidth > 1 ? ( m_opt.kernelWidth - 1 ) / 2 : 0, changed );
+
+	FilterControl control;
+	control.mask = &changed;
+	control.showProgress = false;
+	filter( guide, *m_terms, *m_set, m_opt, m_result, control );
+	result = m_result;
+	return int( std::count( changed.begin(), changed.end(), 1 ) );
+}
+
+void IncrementalDenoiser::diff( const std::vector< const Image* > &frames, std::vector< unsigned char > &changed ) const
+{
+	const int width = m_frames[0].width(), height = m_frames[0].height();
+	for( unsigned int i = 0; i < frames.size(); ++i )
+	{
+		const int channels = frames[i]->channels();
+		for( int y = 0; y < height; ++y )
+		{
+			for( int x = 0; x < width; ++x )
+			{
+				const double *a = frames[i]->at( x, y ), *b = m_frames[i].at( x, y );
+				changed[ y * width + x ] |= !std::equal( a, a + channels, b );
+			}
+		}
+	}
+}
+
+void IncrementalDenoiser::buildGuides( const std::vector< const Image* > &frames )
+{
+	m_guides.clear();
+	if( m_opt.weightMode != Options::kPerChannel )
+	{
+		m_guides.resize( frames.size() );
+		for( unsigned int i = 0; i < frames.size(); ++i )
+		{
+			weightGuide( *frames[i], m_opt, m_guides[i] );
+		}
+	}
+}
+
+std::vector< const Image* > IncrementalDenoiser::guidePointers() const
+{
+	std::vector< const Image* > pointers( m_guides.size() );
+	for( unsigned int i = 0; i < m_guides.size(); ++i )
+	{
+		pointers[i] = &m_guides[i];
+	}
+	return pointers;
+}
@@ -0,0 +1,203 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include "Options.h"
+#include "Image.h"
+#include "Filter.h"
+#include "LumaChroma.h"
+
+namespace
+{
+
+/// Co and Cg lie in [-.5, .5] for RGB values in [0, 1]. They are offset into [0, 1] and kept above
+/// zero because the sample set treats zero as a missing sample.
+const double kChromaOffset = .5;
+const double kChromaMin = 1e-6;
+
+/// Splits each RGB layer of the image into a luma channel of luma and the Co and Cg channels of
+/// chroma, which are averaged over blocks of scale x scale pixels. Pixels that are black in every
+/// channel are missing samples and so are kept as zero luma and left out of the chroma averages.
+void splitLumaChroma( const Image &image, int scale, Image &luma, Image &chroma )
+{
+	const int width = image.width(), height = image.height(), nLayers = image.channels() / 3;
+	const int chromaWidth = ( width + scale - 1 ) / scale, chromaHeight = ( height + scale - 1 ) / scale;
+	luma.resize( width, height, nLayers );
+	chroma.resize( chromaWidth, chromaHeight, nLayers * 2 );
+
+	std::vector< double > sums( chromaWidth * nLayers * 3 );
+	for( int cy = 0; cy < chromaHeight; ++cy )
+	{
+		std::fill( sums.begin(), sums.end(), 0. );
+		for( int y = cy * scale; y < std::min( ( cy + 1 ) * scale, height ); ++y )
+		{
+			for( int x = 0; x < width; ++x )
+			{
+				const double *in = image.readable( x, y );
+				double *out = luma.writeable( x, y );
+				for( int l = 0; l < nLayers; ++l )
+				{
+					const double r = in[ l * 3 ], g = in[ l * 3 + 1 ], b = in[ l * 3 + 2 ];
+					if( r == 0. && g == 0. && b == 0. )
+					{
+						out[l] = 0.;
+						continue;
+					}
+
+					out[l] = .25 * r + .5 * g + .25 * b;
+					double *sum = &sums[ ( ( x / scale ) * nLayers + l ) * 3 ];
+					sum[0] += .5 * ( r - b );
+					sum[1] += .5 * g - .25 * ( r + b );
+					sum[2] += 1.;
+				}
+			}
+		}
+
+		for( int cx = 0; cx < chromaWidth; ++cx )
+		{
+			double *out = chroma.writeable( cx, cy );
+			for( int l = 0; l < nLayers; ++l )
+			{
+				const double *sum = &sums[ ( cx * nLayers + l ) * 3 ];
+				out[ l * 2 ] = sum[2] > 0. ? std::max( sum[0] / sum[2] + kChromaOffset, kChromaMin ) : 0.;
+				out[ l * 2 + 1 ] = sum[2] > 0. ? std::max( sum[1] / sum[2] + kChromaOffset, kChromaMin ) : 0.;
+			}
+		}
+	}
+}
+
+/// Returns channel c of the chroma image at the full resolution position ( x, y ) by bilinear
+/// interpolation between the centres of the blocks. Blocks without any samples are neutral.
+inline double chromaAt( const Image &chroma, int scale, int x, int y, int c )
+{
+	const double fx = std::max( ( x + .5 ) / scale - .5, 0. ), fy = std::max( ( y + .5 ) / scale - .5, 0. );
+	const int x0 = std::min( int( fx ), chroma.width() - 1 ), y0 = std::min( int( fy ), chroma.height() - 1 );
+	const int x1 = std::min( x0 + 1, chroma.width() - 1 ), y1 = std::min( y0 + 1, chroma.height() - 1 );
+	const double tx = std::min( fx - x0, 1. ), ty = std::min( fy - y0, 1. );
+
+	double v[4] = { chroma.readable( x0, y0 )[c], chroma.readable( x1, y0 )[c], chroma.readable( x0, y1 )[c], chroma.readable( x1, y1 )[c] };
+	for( int i = 0; i < 4; ++i )
+	{
+		v[i] = v[i] == 0. ? 0. : v[i] - kChromaOffset;
+	}
+	return ( v[0] * ( 1. - tx ) + v[1] * tx ) * ( 1. - ty ) + ( v[2] * ( 1. - tx ) + v[3] * tx ) * ty;
+}
+
+/// Converts the filtered luma and the upsampled chroma back to RGB layers.
+void joinLumaChroma( const Image &luma, const Image &chroma, int scale, Image &result )
+{
+	const int width = luma.width(), height = luma.height(), nLayers = luma.channels();
+	result.resize( width, height, nLayers * 3 );
+	for( int y = 0; y < height; ++y )
+	{
+		for( int x = 0; x < width; ++x )
+		{
+			const double *in = luma.readable( x, y );
+			double *out = result.writeable( x, y );
+			for( int l = 0; l < nLayers; ++l )
+			{
+				const double co = chromaAt( chroma, scale, x, y, l * 2 );
+				const double cg = chromaAt( chroma, scale, x, y, l * 2 + 1 );
+				const double t = in[l] - cg;
+				out[ l * 3 ] = std::max( t + co, 0. );
+				out[ l * 3 + 1 ] = std::max( in[l] + cg, 0. );
+				out[ l * 3 + 2 ] = std::max( t - co, 0. );
+			}
+		}
+	}
+}
+
+/// Builds the sample set of the first nChannels channels of the images when they have more
+/// than that, which is used to guide every layer with the beauty pass.
+std::unique_ptr< SampleSet > layerGuide( const std::vector< Image > &images, int nChannels )
+{
+	std::unique_ptr< SampleSet > guide;
+	if( images[0].channels() > nChannels )
+	{
+		std::vector< Image > layers( images.size() );
+		for( unsigned int i = 0; i < images.size(); ++i )
+		{
+			extractLayer( images[i], 0, nChannels, layers[i] );
+		}
+		guide.reset( new SampleSet( layers ) );
+	}
+	return guide;
+}
+
+} // namespace
+
+void denoiseLumaChroma( const std::vector< const Image* > &images, const Options &opt, Image &result, bool showProgress )
+{
+	if( images[0]->channels() % 3 != 0 )
+	{
+		throw std::runtime_error( "Luma and chroma can only be filtered for images made of RGB layers." );
+	}
+
+	const int scale = std::max( opt.chromaScale, 1 );
+	std::vector< Image > lumas( images.size() ), chromas( images.size() );
+	for( unsigned int i = 0; i < images.size(); ++i )
+	{
+		splitLumaChroma( *images[i], scale, lumas[i], chromas[i] );
+	}
+
+	// Luma guides itself and chroma is weighted per channel. The chroma kernel covers the
+	// same area of the image as the luma kernel, but never less than the 8 neighbours.
+	Options lumaOpt = opt;
+	lumaOpt.weightMode = Options::kPerChannel;
+	Options chromaOpt = lumaOpt;
+	const int kernelRadius = opt.kernelWidth > 1 ? ( opt.kernelWidth - 1 ) / 2 : 0;
+	chromaOpt.kernelWidth = 2 * std::max( ( kernelRadius + scale / 2 ) / scale, 1 ) + 1;
+	chromaOpt.minKernelWidth = std::min( opt.minKernelWidth, chromaOpt.kernelWidth );
+
+	if( showProgress )
+	{
+		fprintf( stderr, "Filtering luma at %dx%d with kernel width %d and chroma at %dx%d with kernel width %d.\n", lumas[0].width(), lumas[0].height(), lumaOpt.kernelWidth, chromas[0].width(), chromas[0].height(), chromaOpt.kernelWidth );
+	}
+
+	Image luma, chroma;
+	{
+		SampleSet set( lumas );
+		std::unique_ptr< SampleSet > guide = layerGuide( lumas, 1 );
+		filter( guide ? *guide : set, set, lumaOpt, luma, showProgress );
+	}
+	{
+		SampleSet set( chromas );
+		std::unique_ptr< SampleSet > guide = layerGuide( chromas, 2 );
+		filter( guide ? *guide : set, set, chromaOpt, chroma, showProgress );
+	}
+
+	joinLumaChroma( luma, chroma, scale, result );
+}
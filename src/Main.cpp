@@ -30,6 +30,7 @@
 /// \todo Remove these C headers and replace with C++.
 #include <math.h>
 #include <stdio.h>
+#include <sys/stat.h>
 
 // C++ headers.
 #include <iostream>
@@ -38,52 +39,253 @@
 #include <vector>
 #include <algorithm> // For atoi(), atof()
 #include <stdexcept>
+#include <chrono>
+#include <memory>
+#include <thread>
 
 #include "Options.h"
 #include "Image.h"
+#include "Filter.h"
+#include "Stream.h"
+#include "Tune.h"
+#include "Writer.h"
+#include "Benchmark.h"
+#include "Progressive.h"
+#include "Checkpoint.h"
+#include "Sequence.h"
+#include "Incremental.h"
 
-/// Returns the Gaussian weight for a point 'x' in a normal distribution
-/// centered at the mean with the given deviation.
-double gaussian( double x, double mean, double deviation, bool normalize = true )
+/// Filters the images again with the plain filter, which weights each RGB channel with its own
+/// samples at full resolution and with a fixed kernel, and prints how the result of the faster
+/// modes selected in opt compares with it and the ground truth.
+static void report( const std::vector< const Image* > &frames, const Options &opt, const Image &result, double time )
 {
-	double c = deviation;
-	double a = c * sqrt( 2 * M_PI );
-	double b = x - mean;
-	double v = a * exp( -( ( b * b ) / ( 2*c*c ) ) );
-	return normalize ? v / a : v;
+	Options reference = opt;
+	reference.weightMode = Options::kPerChannel;
+	reference.chromaScale = 0;
+	reference.minKernelWidth = 0;
+	if( opt.weightMode == reference.weightMode && opt.chromaScale == reference.chromaScale && opt.minKernelWidth == reference.minKernelWidth )
+	{
+		std::cerr << "The report compares a faster mode with the plain filter. Please select shared weights with --weights, luma and chroma with --lumaChroma or adaptive kernels with --adaptiveKernel." << std::endl;
+		return;
+	}
+
+	Image plain;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	denoise( frames, reference, plain, false );
+	double referenceTime = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+
+	std::cerr << "Report:" << std::endl;
+	if( opt.weightMode != Options::kPerChannel )
+	{
+		std::cerr << "\tWeight evaluations per pixel: " << 1 << " shared vs " << 3 << " per channel." << std::endl;
+	}
+	std::cerr << "\tTime: " << time << "s vs " << referenceTime << "s for the plain filter (" << referenceTime / time << "x)." << std::endl;
+	std::cerr << "\tPSNR against the plain filter: " << psnr( result, plain ) << "dB." << std::endl;
+
+	Image truth;
+	FILE *f = fopen( groundTruthPath( opt ).c_str(), "r" );
+	if( f != NULL )
+	{
+		fclose( f );
+		readPPM( groundTruthPath( opt ), truth );
+		std::cerr << "\tPSNR against \"" << groundTruthPath( opt ) << "\": " << psnr( result, truth ) << "dB vs " << psnr( plain, truth ) << "dB for the plain filter." << std::endl;
+	}
 }
 
-/// A step function which has a falloff that starts when the value 'x'
-/// gets within 10% of a limit. The returned value will never reach 0
-/// if it is within range. Values of 'x' that are out of the range 
-/// are set to 0.
-double softStep( double x, double min, double max )
+/// Writes the beauty pass of the result to the output path and each AOV layer next to it, using
+/// layers to hold the extracted AOVs. When replace is set each file is written under a temporary
+/// name and then renamed over the output so that a viewer never reads a partly written image.
+static bool writeLayers( const Image &result, const Options &opt, std::vector< Image > &layers, bool async, bool replace )
 {
-	if( x < min || x > max )
+	// Each layer is encoded and written while the next one is extracted.
+	BackgroundWriter writer;
+	for( unsigned int l = 0; l < layers.size(); ++l )
 	{
-		return 0;
+		std::string path = opt.outputPath;
+		if( l > 0 )
+		{
+			path.insert( path.length() - 4, "." + opt.aovs[l-1] );
+			extractLayer( result, l * 3, 3, layers[l] );
+		}
+
+		const Image &layer = l == 0 ? result : layers[l];
+		const bool bmp = opt.extension == "bmp";
+		writer.submit( [path, &layer, bmp, replace]()
+		{
+			const std::string target = replace ? path + ".part" : path;
+			if( !( bmp ? writeBMP( target, layer ) : writePPM( target, layer ) ) )
+			{
+				return false;
+			}
+			return !replace || rename( target.c_str(), path.c_str() ) == 0;
+		}, async );
 	}
 
-	double v = ( max - min ) * .1;
-	double lower = min + v;
-	double upper = max - v;
-	if( x < min + v )
+	return writer.wait();
+}
+
+/// Reads frame i of the sequence into image, stacking its AOVs behind the beauty pass
+/// as extra channels and using layers to hold them as they are read.
+static bool readFrame( const Options &opt, int i, std::vector< Image > &layers, Image &image )
+{
+	std::vector< const Image* > layerPointers( layers.size() );
+	for( unsigned int l = 0; l < layers.size(); ++l )
 	{
-		x = ( x - min ) / ( lower - min );
+		const std::string name = l == 0 ? "image" : opt.aovs[l-1];
+		if( !readPPM( sequencePath( name, opt, i ), layers[l] ) )
+		{
+			std::cerr << "Failed to open image " << sequencePath( name, opt, i ) << std::endl;
+			return false;
+		}
+		layerPointers[l] = &layers[l];
 	}
-	else if( x > max - v )
+
+	if( layers.size() == 1 )
 	{
-		x = 1. - ( x - upper ) / ( max - upper );
+		std::swap( image, layers[0] );
 	}
 	else
 	{
-		return 1.;
+		stackLayers( layerPointers, image );
+	}
+	return true;
+}
+
+/// Returns a string which changes when one of the files of frame i is replaced or its size or
+/// modification time changes, and sets modified to the newest of the modification times.
+static std::string frameStamp( const Options &opt, int i, double &modified )
+{
+	std::ostringstream stamp;
+	modified = 0.;
+	for( unsigned int l = 0; l <= opt.aovs.size(); ++l )
+	{
+		struct stat info;
+		if( stat( sequencePath( l == 0 ? "image" : opt.aovs[l-1], opt, i ).c_str(), &info ) == 0 )
+		{
+			stamp << info.st_ino << ":" << info.st_mtim.tv_sec << "." << info.st_mtim.tv_nsec << ":" << info.st_size << ";";
+			modified = std::max( modified, info.st_mtim.tv_sec + info.st_mtim.tv_nsec * 1e-9 );
+		}
+	}
+	return stamp.str();
+}
+
+/// The seconds since the epoch, on the clock that file modification times are taken from.
+static double wallClock()
+{
+	return std::chrono::duration< double >( std::chrono::system_clock::now().time_since_epoch() ).count();
+}
+
+/// Appends the rectangles listed in the file at path, one "x y width height" per line,
+/// to hints and removes the file. Returns false if there is no such file.
+static bool readHints( const std::string &path, std::vector< DirtyRect > &hints )
+{
+	FILE *f = fopen( path.c_str(), "r" );
+	if( f == NULL )
+	{
+		return false;
 	}
 
-	// We ensure that the weight returns a contribution of at least .0025;
-	x = .05 + ( x * .95 );
+	DirtyRect rect;
+	while( fscanf( f, "%d %d %d %d", &rect.x, &rect.y, &rect.width, &rect.height ) == 4 )
+	{
+		hints.push_back( rect );
+	}
+	fclose( f );
+	remove( path.c_str() );
+	return true;
+}
+
+/// Checks the frames for changes every opt.watchInterval seconds and, when some have been
+/// rewritten, filters the pixels around the changes again and rewrites the output. The
+/// changed rectangles are read from the "<frame>.dirty" files when every rewritten frame
+/// has one, and otherwise found by comparing the frames. Runs until the process is stopped.
+static int watch( const Options &opt, std::vector< Image > &images, std::vector< Image > &layers, IncrementalDenoiser &denoiser )
+{
+	// A file system may only keep modification times to the second, so a frame which is rewritten
+	// with the same size soon after it was read can keep its stamp. Until a frame was read more than
+	// a second after it was last modified it is read again on every check and compared with the
+	// previous one. The stamps start out empty, which also catches the frames which were rewritten
+	// while the first result was being filtered.
+	const double kStampResolution = 1.;
+	std::vector< const Image* > frames( images.size() );
+	std::vector< std::string > stamps( images.size() );
+	std::vector< double > modified( images.size(), 0. ), readAt( images.size(), 0. );
+	for( unsigned int i = 0; i < images.size(); ++i )
+	{
+		frames[i] = &images[i];
+	}
+
+	std::cerr << "Watching the frames for changes." << std::endl;
+	Image result;
+	while( true )
+	{
+		std::this_thread::sleep_for( std::chrono::duration< double >( opt.watchInterval ) );
+
+		std::vector< DirtyRect > hints;
+		bool changed = false, hinted = true;
+		for( unsigned int i = 0; i < images.size(); ++i )
+		{
+			const std::string hintPath = sequencePath( "image", opt, i ) + ".dirty";
+			const double now = wallClock();
+			double newest = 0.;
+			const std::string stamp = frameStamp( opt, i, newest );
+			FILE *f = fopen( hintPath.c_str(), "r" );
+			const bool hasHints = f != NULL;
+			if( f != NULL )
+			{
+				fclose( f );
+			}
+			const bool settled = readAt[i] - modified[i] > kStampResolution;
+			if( stamp == stamps[i] && settled && !hasHints )
+			{
+				continue;
+			}
+
+			// A frame which is still being written is read again on the next check.
+			try
+			{
+				if( !readFrame( opt, i, layers, images[i] ) )
+				{
+					continue;
+				}
+			}
+			catch( const std::runtime_error &e )
+			{
+				std::cerr << e.what() << std::endl;
+				continue;
+			}
+			stamps[i] = stamp;
+			modified[i] = newest;
+			readAt[i] = now;
+			changed = true;
+			hinted = readHints( hintPath, hints ) && hinted;
+		}
+
+		if( !changed )
+		{
+			continue;
+		}
+		if( !hinted )
+		{
+			hints.clear();
+		}
 
-	return x * x;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const int filtered = denoiser.update( frames, hints, result );
+		double time = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+		if( filtered == 0 )
+		{
+			continue;
+		}
+		std::cerr << "Filtered " << filtered << " of " << result.width() * result.height() << " pixels again in " << time << "s." << std::endl;
+
+		if( !writeLayers( result, opt, layers, opt.asyncWrite, true ) )
+		{
+			std::cerr << "Failed to write image." << std::endl;
+			return 1;
+		}
+	}
 }
 
 int main( int argc, char* argv[] )
@@ -108,153 +310,112 @@ int main( int argc, char* argv[] )
 	std::cerr << "Contribution strength: " << opt.contributionStrength << std::endl;
 	std::cerr << "Kernel width: " << opt.kernelWidth << std::endl;
 
-	// Load the images.
+	if( opt.tune != Options::kTuneOff && !autotune( opt ) )
+	{
+		std::cerr << "Failed to tune the filter." << std::endl;
+		return 1;
+	}
+	std::cerr << "Threads: " << filterThreads( opt ) << std::endl;
+	std::cerr << "Tile size: " << ( opt.tileSize > 0 ? std::to_string( opt.tileSize ) : std::string( "Fit to the L2 cache" ) ) << std::endl;
+	std::cerr << "Tile order: " << ( opt.tileOrder == Options::kHilbert ? "Hilbert" : opt.tileOrder == Options::kZOrder ? "Z-order" : "Raster" ) << std::endl;
+	std::cerr << "Kernel variant: " << ( opt.kernelVariant == Options::kChannelMajor ? "Channel major" : "Pixel major" ) << std::endl;
+
+	if( !opt.generatePath.empty() )
+	{
+		return generateSequence( opt );
+	}
+
+	if( opt.scaling )
+	{
+		return scaling( opt );
+	}
+
+	if( !opt.streamPath.empty() )
+	{
+		std::cerr << "Streaming from: \"" << opt.streamPath << "\"." << std::endl;
+		return denoiseStream( opt );
+	}
+
+	// Load the images. The AOVs are stacked behind the beauty pass as extra channels so
+	// that the filter can apply the weights it computes for the beauty pass to them too.
 	std::vector< Image > images( opt.nImages );
-	int frame = opt.startFrame;
+	std::vector< Image > layers( opt.aovs.size() + 1 );
 	for( unsigned int i = 0; i < images.size(); ++i )
 	{
-		std::stringstream s;
-		s << "images/image" << opt.sequenceNumber << "." << frame << ".ppm";
-
-		if( !readPPM( s.str(), images[i] ) )
+		if( !readFrame( opt, i, layers, images[i] ) )
 		{
-			std::cerr << "Failed to open image " << s.str() << std::endl;
 			return 1;
 		}
-		
-		if( ++frame >= 11 )
-		{
-			frame = 0;
-		}
 	}
 
 	//===================================================================
 	// The algorithm.
 	//===================================================================
 
-	SampleSet set( images );
-	const int width = set.width(), height = set.height();
-	Image result( width, height );
+	std::vector< const Image* > frames( images.size() );
+	for( unsigned int i = 0; i < images.size(); ++i )
+	{
+		frames[i] = &images[i];
+	}
+
+	if( opt.benchmark )
+	{
+		return benchmark( frames, opt );
+	}
 
-				
-	int kernelRadius = opt.kernelWidth > 1 ? ( opt.kernelWidth - 1 ) / 2 : 0;
-	std::vector< double > srcSamples;
-	for( int y = 0; y < height; ++y )
+	if( opt.progressive )
 	{
-		for( int x = 0; x < width; ++x )
+		return progressive( frames, opt, [&]( const Image &result )
 		{
-			fprintf(stderr,"\rFiltering %5.2f%% complete.", 100. * y / ( height-1 ) );
-		
-			// Loop over each channel.	
-			for( unsigned int c = 0; c < 3; ++c )
+			if( !writeLayers( result, opt, layers, opt.asyncWrite, true ) )
 			{
-				double destMean = set.mean( x, y, c );
-				double destDeviation = set.deviation( x, y, c );
-				double destVariation = set.variance( x, y, c );
-				double destRange = set.max( x, y, c ) - set.min( x, y, c ); 
-
-				// Loop over the neighbouring pixels.
-				double weightedSum = 0.;
-				double v = 0.;
-				for( int ky = -kernelRadius; ky <= kernelRadius; ++ky )
-				{
-					for( int kx = -kernelRadius; kx <= kernelRadius; ++kx )
-					{
-						// Don't include the pixel being sampled in our calculations as we are
-						// summing the deviations from it and doing so will bias our results.
-						if( ky == 0 && kx == 0 )
-						{
-							continue;
-						}
-
-						// Gather information on the source pixel's samples.
-						srcSamples = set.samples( x + kx, y + ky, c );
-						double srcMin = set.min( x + kx, y + ky, c );
-						double srcMax = set.max( x + kx, y + ky, c );
-						double srcMean = set.mean( x + kx, y + ky, c );
-						double srcDeviation = set.deviation( x + kx, y + ky, c );
-						double srcVariation = set.variance( x + kx, y + ky, c );
-						double srcRange = set.max( x + kx, y + ky, c ) - set.min( x + kx, y + ky, c ); 
-						
-						if( srcVariation == 0 && srcSamples[0] == 0. ) continue;
-							
-						// A gaussian falloff that weights contributing samples which are closer to the pixel being filtered higher.
-						/// \todo Intuitive falloff parameters need to be added to the distance weight or at least a suitable curve found.
-						double distanceWeight = gaussian( sqrt( kx*kx + ky*ky ) / sqrt( kernelRadius*kernelRadius + kernelRadius*kernelRadius ), 0., .7, false );
-							
-						// Similarity weight.
-						// This weight defines a measure of how similar the set of contributing samples is to the pixel being filtered.
-						// By itself it will produce a smart blur of sorts which is then attenuated by the variance of the source samples in the process of weighted offsets.
-						// Changing this value will effect how aggressive the filtering is.
-						double similarity;
-						if( opt.blurMode == Options::kAggressive )
-						{
-							similarity = ( srcMean - destMean ) * ( srcRange - destRange );
-						}
-						else
-						{
-							similarity = ( srcMean - destMean );
-						}
-						similarity *= similarity;
-
-						// Temporal weight.
-						// Weight the contribution using a function in the range of 0-1 which weights the importance of the
-						// contributing sample according to how close it is in time to the current time.
-						double time = 1.; // \todo: implement this! Example functions are Median, Gaussian, etc.
-
-						// Loop over each of the neighbouring samples.
-						for( unsigned int i = 0; i < srcSamples.size(); ++i )
-						{
-							// The contribution weight extends the range of allowed samples that can influence the pixel being filtered.
-							// It is simply a scaler that increases the width of the bell curve that the samples are weighted against.
-							double contribution = gaussian( srcSamples[i], destMean, destDeviation * ( 1 + opt.contributionStrength ) ) * gaussian( srcSamples[i], srcMean, srcDeviation );
-							contribution = contribution * ( 1. - opt.blurStrength ) + opt.blurStrength;
-
-							// This weight is a step function with a strong falloff close to the limits. However, it will never reach 0 so that the sample is not excluded.
-							// By using this weight the dependency on the limiting samples is much less which reduces the effect of sparkling artefacts.
-							double limitWeight = srcSamples.size() <= 2 ? 1. : softStep( srcSamples[i], srcMin, srcMax );
-						
-							// Combine the weights together and normalize to the range of 0-1.	
-							double weight = pow( M_E, -( similarity / ( contribution * srcVariation * time * distanceWeight * limitWeight ) ) );
-							weight = ( isnan( weight ) || isinf( weight ) ) ? 0. : weight;
-						
-							// Sum the offset.	
-							v += ( srcSamples[i] - destMean ) * weight;
-
-							// Sum the weight.
-							weightedSum += weight;
-						}
-					}
-				}
-
-				if( weightedSum == 0. || destVariation <= 0. )
-				{
-					result.writeable( x, y )[c] = destMean;
-				}
-				else
-				{
-					result.writeable( x, y )[c] = destMean + ( v / weightedSum );
-				}
+				std::cerr << "Failed to write image." << std::endl;
+				return false;
 			}
-		}
+			return true;
+		} );
 	}
 
-	bool success = false;
-	if( opt.extension == "bmp" )
+	Image result;
+	IncrementalDenoiser incremental( opt );
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if( opt.watch )
 	{
-		success = writeBMP( opt.outputPath.c_str(), result );
+		incremental.denoise( frames, result );
 	}
-	else
+	else if( opt.checkpointPath.empty() )
+	{
+		denoise( frames, opt, result );
+	}
+	else if( !denoiseWithCheckpoints( frames, opt, result ) )
+	{
+		return 1;
+	}
+	double time = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+	std::cerr << "Filtered in " << time << "s." << std::endl;
+
+	if( opt.report )
 	{
-		success = writePPM( opt.outputPath.c_str(), result );
+		report( frames, opt, result, time );
 	}
-	
-	if( !success )
+
+	if( !writeLayers( result, opt, layers, opt.asyncWrite, opt.watch ) )
 	{
 		std::cerr << "Failed to write image." << std::endl;
 		return 1;
 	}
 
+	// The checkpoint is only needed until the output is safely written.
+	if( !opt.checkpointPath.empty() )
+	{
+		remove( opt.checkpointPath.c_str() );
+	}
+
+	if( opt.watch )
+	{
+		return watch( opt, images, layers, incremental );
+	}
+
 	return 0;
 }
 
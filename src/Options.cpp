@@ -25,7 +25,12 @@
 //  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 //////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+
 #include <iostream>
+#include <string>
+#include <vector>
 #include <algorithm> // For atoi(), atof()
 
 #include "Options.h"
@@ -33,12 +38,13 @@
 /// Prints the help message when using the -h option.
 static void helpMessage( std::string name )
 {
-    std::cerr << "Usage: " << name << " [ -h | -n <numberOfImages> | -b <blur> | -k <opt.kernelWidth> | -c <contribution> | -i <imageSequence> | -o <output> ]" << std::endl
+    std::cerr << "Usage: " << name << " [ -h | -n <numberOfImages> | -b <blur> | -k <opt.kernelWidth> | -c <contribution> | -i <imageSequence> | -o <output> | -st <stream> | -t <threads> | -ts <tileSize> | -kv <kernelVariant> | --autotune | --retune | -a <aov> | -w <weightMode> | --asyncWrite | -to <tileOrder> | --benchmark | --compact | --progressive | --deadline <seconds> | -ak <minKernelWidth> | --adaptiveNoise <deviation> | -yc <chromaScale> | --report | -cp <checkpoint> | --checkpointInterval <seconds> | -id <imageDirectory> | -sl <sequenceLength> | --generate <directory> | --scaling | -re <epsilon> | --watch | --watchInterval <seconds> ]" << std::endl
               << "Options:" << std::endl
               << "\t-h, --help\t\tShow this help message." << std::endl
               << "\t-o, --output X\t\tSpecifies the output path. The supported file types are PPM and BMP." << std::endl
-              << "\t-i, --image X\t\tChange the preset sequence of images to filter. The argument must be an integer in the range of 0-4." << std::endl
-              << "\t-n, --numberOfImages X\tSpecify the number of images to used. 10 is the maximum." << std::endl
+              << "\t-i, --image X\t\tChange the preset sequence of images to filter. The argument must be an integer in the range of 0-4" << std::endl
+			  << "\t\t\t\tunless the images are read from another directory." << std::endl
+              << "\t-n, --numberOfImages X\tSpecify the number of images to used. Frames are reused if it is more than the sequence length." << std::endl
               << "\t-b, --blur X\t\tSpecify the amount of smart blur to apply. The range is 0-1 and the default is 0.005." << std::endl
 			  << "\t\t\t\tBe aware that when the smart blur is fully on, the \"contribution\" weight will have no effect." << std::endl
 			  << "\t-bm, --blurMode X\tSpecifies the type of smart blur used by the algorithm. 0: Agressive, 1: Regular." << std::endl
@@ -50,13 +56,71 @@ static void helpMessage( std::string name )
 			  << "\t\t\t\tsequence will loop if the number of required images extends past those which are available." << std::endl
 			  << "\t\t\t\tBy increasing this value, high frequency noise that is present in the filtered image which is the result of" << std::endl
 			  << "\t\t\t\tundersampling in the render is reduced." << std::endl
+              << "\t-st, --stream X\t\tReads a raw frame stream from the path X, or stdin if X is \"-\", and writes each denoised" << std::endl
+			  << "\t\t\t\tframe to stdout as soon as the window of \"numberOfImages\" frames that ends with it has arrived." << std::endl
+			  << "\t\t\t\tThe stream is a \"TDS\\n<width> <height>\\n<u8|f32>\\n\" header followed by raw interleaved RGB frames." << std::endl
+              << "\t-t, --threads X\t\tSets the number of filter threads. The default of 0 uses one per hardware thread." << std::endl
+              << "\t-ts, --tileSize X\tSets the width and height of the tiles that the image is split into for filtering." << std::endl
+			  << "\t\t\t\tThe default of 0 picks the largest tile whose samples fit in the L2 cache." << std::endl
+              << "\t-to, --tileOrder X\tSelects the order the tiles are filtered in. 0: Raster, 1: Z-order, 2: Hilbert curve." << std::endl
+              << "\t-kv, --kernelVariant X\tSelects the order the filter visits a tile in. 0: Pixel major, 1: Channel major." << std::endl
+              << "\t--autotune\t\tUses the fastest threads, tile size and kernel variant for this host. They are measured on the" << std::endl
+			  << "\t\t\t\tfirst run and cached in \"$HOME/.temporalDenoise.<hostname>.tune\" for later runs." << std::endl
+              << "\t--retune\t\tLike --autotune but always re-runs the measurements and replaces the cached result." << std::endl
+              << "\t--tuneCache X\t\tOverrides the path of the tuning cache file." << std::endl
+              << "\t-a, --aov X\t\tAlso filters the AOV sequence \"images/X<imageSequence>.<frame>.ppm\" using the weights of the" << std::endl
+			  << "\t\t\t\tbeauty pass and writes it next to the output with \".X\" inserted before the extension." << std::endl
+			  << "\t\t\t\tThe option can be given more than once." << std::endl
+              << "\t-w, --weights X\t\tSelects what the filter weights are computed from. 0: Each channel (the default)," << std::endl
+			  << "\t\t\t\t1: Luminance, 2: The largest channel. Modes 1 and 2 compute the weights once and share them" << std::endl
+			  << "\t\t\t\tbetween the channels which is around three times faster." << std::endl
+              << "\t--report\t\tAlso runs the plain filter, with per channel weights, RGB channels and a fixed kernel," << std::endl
+			  << "\t\t\t\tand reports how the result of the selected modes compares. --weightReport is the same." << std::endl
+              << "\t--asyncWrite\t\tEncodes and writes each output on a background thread while the next one is filtered." << std::endl
+              << "\t--benchmark\t\tTimes the filter, and counts cache misses where the system allows it, without tiles and" << std::endl
+			  << "\t\t\t\twith each tile order, all on one thread, instead of writing an output." << std::endl
+              << "\t--compact\t\tStores the samples as their 8 bit codes, which takes an eighth of the memory, when every" << std::endl
+			  << "\t\t\t\tinput is an 8 bit image." << std::endl
+              << "\t--progressive\t\tWrites a quick preview to the output and then rewrites it as each refinement pass" << std::endl
+			  << "\t\t\t\tcompletes, up to the full result." << std::endl
+              << "\t--deadline X\t\tRuns progressively and stops after X seconds, leaving the best completed pass." << std::endl
+              << "\t-ak, --adaptiveKernel X\tPicks the kernel width of each pixel between X and the kernel width from the" << std::endl
+			  << "\t\t\t\tdeviation of its samples, so that converged pixels are filtered with small kernels." << std::endl
+              << "\t--adaptiveNoise X\tThe sample deviation at which an adaptive kernel reaches the full width. Default 0.1." << std::endl
+              << "\t-yc, --lumaChroma X\tFilters luma ( YCoCg ) at full resolution and chroma at 1 / X of the resolution, where" << std::endl
+			  << "\t\t\t\tX is 1, 2 or 4, with a kernel scaled to match. 0 filters the RGB channels (the default)." << std::endl
+			  << "\t\t\t\tIt can't be combined with --progressive, --benchmark or --scaling." << std::endl
+              << "\t-cp, --checkpoint X\tSaves the completed tiles to the file X as the filter runs. If the run is killed, running" << std::endl
+			  << "\t\t\t\tit again with the same options and inputs only filters the missing tiles. The file is" << std::endl
+			  << "\t\t\t\tremoved once the output has been written. It can't be combined with --lumaChroma," << std::endl
+			  << "\t\t\t\t--progressive, --benchmark, --scaling, --stream or --generate." << std::endl
+              << "\t--checkpointInterval X\tThe least number of seconds between checkpoint writes. Default 10." << std::endl
+              << "\t-re, --rejectEpsilon X\tSkips the neighbours and samples whose weight is bounded below X without evaluating" << std::endl
+			  << "\t\t\t\tit, and reports how much was skipped and how far the result can be from the exact one." << std::endl
+              << "\t--watch\t\t\tKeeps running after writing the output. When frames are rewritten, only the pixels" << std::endl
+			  << "\t\t\t\twithin the kernel of the changes are filtered again and the output is rewritten. The" << std::endl
+			  << "\t\t\t\tchanges are found by comparing the frames, or read from \"<frame>.dirty\", which holds" << std::endl
+			  << "\t\t\t\tthe changed rectangles as lines of \"x y width height\" and is removed once read." << std::endl
+			  << "\t\t\t\tIt is ignored with --progressive, --benchmark, --scaling, --stream and --generate." << std::endl
+              << "\t--watchInterval X\tThe seconds between checks for rewritten frames. Default 0.5." << std::endl
+              << "\t-id, --imageDirectory X\tReads the sequences from the directory X rather than \"images\". The ground truth is" << std::endl
+			  << "\t\t\t\tread from X too." << std::endl
+              << "\t-sl, --sequenceLength X\tThe number of frames in each sequence. The default of 11 matches the preset sequences." << std::endl
+              << "\t--generate X\t\tWrites a noisy sequence of \"sequenceLength\" frames to \"X/image<imageSequence>.<frame>.ppm\"," << std::endl
+			  << "\t\t\t\tand the clean image to \"X/groundTruth\" like the presets, instead of filtering." << std::endl
+              << "\t--generateFrom X\tGenerates the sequence from the PPM image X instead of a procedural scene." << std::endl
+              << "\t--generateSize WxH\tThe size of the generated frames. The default is the size of the source or 512x512." << std::endl
+              << "\t--noise X\t\tThe deviation of the generated noise for a value of 1. Default 0.05." << std::endl
+              << "\t--fireflies X\t\tThe fraction of generated samples which are saturated fireflies. Default 0.001." << std::endl
+              << "\t--dropouts X\t\tThe fraction of generated pixels which are black like a missing sample. Default 0.05." << std::endl
+              << "\t--seed X\t\tThe seed of the generated noise." << std::endl
+              << "\t--scaling\t\tTimes the filter on generated sequences as the number of threads, the resolution and the" << std::endl
+			  << "\t\t\t\tnumber of images grow, up to \"threads\", \"generateSize\" and \"numberOfImages\"." << std::endl
               << std::endl;
 }
 
 bool options( int argc, char* argv[], Options &opt )
 {
-	const int maxImages = 10;
-
 	// Get any user overrides.
 	for( int i = 1; i < argc; ++i )
 	{
@@ -75,10 +139,6 @@ bool options( int argc, char* argv[], Options &opt )
 				{
 					opt.nImages = 0;
 				}
-				if( opt.nImages > maxImages )
-				{
-					std::cerr << "There are only 11 uniques images available per sequence. Be aware that multiple frames will be reused." << std::endl;
-				}
             }
 			else
 			{
@@ -91,8 +151,6 @@ bool options( int argc, char* argv[], Options &opt )
             if( i + 1 < argc )
 			{
                 opt.startFrame = ::atoi( argv[++i] );
-				while( opt.startFrame < 0 ) opt.startFrame += maxImages;
-				while( opt.startFrame > maxImages ) opt.startFrame -= maxImages;
             }
 			else
 			{
@@ -105,10 +163,10 @@ bool options( int argc, char* argv[], Options &opt )
             if( i + 1 < argc )
 			{
                 opt.sequenceNumber = ::atoi( argv[++i] );
-				if( opt.sequenceNumber < 0 || opt.sequenceNumber > 5 )
+				if( opt.sequenceNumber < 0 )
 				{
 					opt.sequenceNumber = 0;
-					std::cerr << "There are only 5 preset sequences. Selecting sequence 0." << std::endl;
+					std::cerr << "The sequence number can't be negative. Selecting sequence 0." << std::endl;
 				}
             }
 			else
@@ -179,6 +237,428 @@ bool options( int argc, char* argv[], Options &opt )
 				std::cerr << "--output option requires one argument." << std::endl;
                 return 0;
             }  
+        }
+		else if( ( arg == "-st" ) || ( arg == "--stream" ) )
+		{
+            if( i + 1 < argc )
+			{
+				opt.streamPath = argv[++i];
+				if( opt.streamPath.length() == 0 )
+				{
+					std::cerr << "Invalid stream path specified." << std::endl;
+					return 0;
+				}
+            }
+			else
+			{
+				std::cerr << "--stream option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( ( arg == "-t" ) || ( arg == "--threads" ) )
+		{
+            if( i + 1 < argc )
+			{
+                opt.threads = ::atoi( argv[++i] );
+				opt.tuneFixed |= Options::kTuneThreads;
+				if( opt.threads < 0 )
+				{
+					opt.threads = 0;
+					std::cerr << "The number of threads cannot be less than 0. Using one per hardware thread." << std::endl;
+				}
+            }
+			else
+			{
+				std::cerr << "--threads option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( ( arg == "-ts" ) || ( arg == "--tileSize" ) )
+		{
+            if( i + 1 < argc )
+			{
+                opt.tileSize = ::atoi( argv[++i] );
+				opt.tuneFixed |= Options::kTuneTileSize;
+				if( opt.tileSize < 0 )
+				{
+					opt.tileSize = 0;
+					std::cerr << "The tile size cannot be less than 0. Sizing the tiles to fit the cache." << std::endl;
+				}
+            }
+			else
+			{
+				std::cerr << "--tileSize option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( ( arg == "-kv" ) || ( arg == "--kernelVariant" ) )
+		{
+            if( i + 1 < argc )
+			{
+				int variant = ::atoi( argv[++i] );
+				opt.tuneFixed |= Options::kTuneKernelVariant;
+				if( variant == 0 )
+				{
+					opt.kernelVariant = Options::kPixelMajor;
+				}
+				else if( variant == 1 )
+				{
+					opt.kernelVariant = Options::kChannelMajor;
+				}
+				else
+				{
+					opt.kernelVariant = Options::kPixelMajor;
+					std::cerr << "The kernelVariant option must have a value of 0 or 1. Using the default." << std::endl;
+				}
+            }
+			else
+			{
+				std::cerr << "--kernelVariant option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( ( arg == "-to" ) || ( arg == "--tileOrder" ) )
+		{
+            if( i + 1 < argc )
+			{
+				int order = ::atoi( argv[++i] );
+				if( order == 0 )
+				{
+					opt.tileOrder = Options::kRaster;
+				}
+				else if( order == 1 )
+				{
+					opt.tileOrder = Options::kZOrder;
+				}
+				else if( order == 2 )
+				{
+					opt.tileOrder = Options::kHilbert;
+				}
+				else
+				{
+					opt.tileOrder = Options::kRaster;
+					std::cerr << "The tileOrder option must have a value of 0, 1 or 2. Using the default." << std::endl;
+				}
+            }
+			else
+			{
+				std::cerr << "--tileOrder option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( arg == "--benchmark" )
+		{
+			opt.benchmark = true;
+        }
+		else if( arg == "--compact" )
+		{
+			opt.compactSamples = true;
+        }
+		else if( ( arg == "-ak" ) || ( arg == "--adaptiveKernel" ) )
+		{
+            if( i + 1 < argc )
+			{
+				opt.minKernelWidth = std::max( ::atoi( argv[++i] ), 3 );
+            }
+			else
+			{
+				std::cerr << "--adaptiveKernel option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( arg == "--adaptiveNoise" )
+		{
+            if( i + 1 < argc )
+			{
+				opt.adaptiveNoise = std::max( ::atof( argv[++i] ), 0. );
+            }
+			else
+			{
+				std::cerr << "--adaptiveNoise option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( ( arg == "-yc" ) || ( arg == "--lumaChroma" ) )
+		{
+            if( i + 1 < argc )
+			{
+				int scale = ::atoi( argv[++i] );
+				if( scale == 0 || scale == 1 || scale == 2 || scale == 4 )
+				{
+					opt.chromaScale = scale;
+				}
+				else
+				{
+					opt.chromaScale = 0;
+					std::cerr << "The lumaChroma option must have a value of 0, 1, 2 or 4. Using the default." << std::endl;
+				}
+            }
+			else
+			{
+				std::cerr << "--lumaChroma option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( ( arg == "-cp" ) || ( arg == "--checkpoint" ) )
+		{
+            if( i + 1 < argc )
+			{
+				opt.checkpointPath = argv[++i];
+            }
+			else
+			{
+				std::cerr << "--checkpoint option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( arg == "--checkpointInterval" )
+		{
+            if( i + 1 < argc )
+			{
+				opt.checkpointInterval = std::max( ::atof( argv[++i] ), 0. );
+            }
+			else
+			{
+				std::cerr << "--checkpointInterval option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( ( ( arg == "-id" ) || ( arg == "--imageDirectory" ) ) )
+		{
+            if( i + 1 < argc )
+			{
+				opt.imageDirectory = argv[++i];
+            }
+			else
+			{
+				std::cerr << "--imageDirectory option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( ( ( arg == "-sl" ) || ( arg == "--sequenceLength" ) ) )
+		{
+            if( i + 1 < argc )
+			{
+				opt.sequenceLength = std::max( ::atoi( argv[++i] ), 1 );
+            }
+			else
+			{
+				std::cerr << "--sequenceLength option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( arg == "--generate" )
+		{
+            if( i + 1 < argc )
+			{
+				opt.generatePath = argv[++i];
+            }
+			else
+			{
+				std::cerr << "--generate option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( arg == "--generateFrom" )
+		{
+            if( i + 1 < argc )
+			{
+				opt.generateSource = argv[++i];
+            }
+			else
+			{
+				std::cerr << "--generateFrom option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( arg == "--generateSize" )
+		{
+            if( i + 1 < argc )
+			{
+				if( sscanf( argv[++i], "%dx%d", &opt.generateWidth, &opt.generateHeight ) != 2 || opt.generateWidth < 1 || opt.generateHeight < 1 )
+				{
+					opt.generateWidth = opt.generateHeight = 0;
+					std::cerr << "The generateSize option must be given as <width>x<height>. Using the default." << std::endl;
+				}
+            }
+			else
+			{
+				std::cerr << "--generateSize option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( arg == "--noise" )
+		{
+            if( i + 1 < argc )
+			{
+				opt.noise = std::max( ::atof( argv[++i] ), 0. );
+            }
+			else
+			{
+				std::cerr << "--noise option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( arg == "--fireflies" )
+		{
+            if( i + 1 < argc )
+			{
+				opt.fireflies = std::min( std::max( ::atof( argv[++i] ), 0. ), 1. );
+            }
+			else
+			{
+				std::cerr << "--fireflies option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( arg == "--dropouts" )
+		{
+            if( i + 1 < argc )
+			{
+				opt.dropouts = std::min( std::max( ::atof( argv[++i] ), 0. ), 1. );
+            }
+			else
+			{
+				std::cerr << "--dropouts option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( arg == "--seed" )
+		{
+            if( i + 1 < argc )
+			{
+				opt.seed = (unsigned int)::strtoul( argv[++i], NULL, 10 );
+            }
+			else
+			{
+				std::cerr << "--seed option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( arg == "--scaling" )
+		{
+			opt.scaling = true;
+        }
+		else if( ( arg == "-re" ) || ( arg == "--rejectEpsilon" ) )
+		{
+            if( i + 1 < argc )
+			{
+				opt.rejectEpsilon = std::min( std::max( ::atof( argv[++i] ), 0. ), 1. );
+            }
+			else
+			{
+				std::cerr << "--rejectEpsilon option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( arg == "--watch" )
+		{
+			opt.watch = true;
+        }
+		else if( arg == "--watchInterval" )
+		{
+            if( i + 1 < argc )
+			{
+				opt.watchInterval = std::max( ::atof( argv[++i] ), .01 );
+				opt.watch = true;
+            }
+			else
+			{
+				std::cerr << "--watchInterval option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( arg == "--progressive" )
+		{
+			opt.progressive = true;
+        }
+		else if( arg == "--deadline" )
+		{
+            if( i + 1 < argc )
+			{
+				opt.deadline = std::max( ::atof( argv[++i] ), 0. );
+				opt.progressive = true;
+            }
+			else
+			{
+				std::cerr << "--deadline option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( arg == "--autotune" )
+		{
+			opt.tune = std::max( opt.tune, int( Options::kTuneCached ) );
+        }
+		else if( arg == "--retune" )
+		{
+			opt.tune = Options::kTuneForce;
+        }
+		else if( arg == "--tuneCache" )
+		{
+            if( i + 1 < argc )
+			{
+				opt.tuneCachePath = argv[++i];
+            }
+			else
+			{
+				std::cerr << "--tuneCache option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( ( arg == "-a" ) || ( arg == "--aov" ) )
+		{
+            if( i + 1 < argc )
+			{
+				std::string aov( argv[++i] );
+				if( aov.length() == 0 )
+				{
+					std::cerr << "Invalid AOV name specified." << std::endl;
+					return 0;
+				}
+				opt.aovs.push_back( aov );
+            }
+			else
+			{
+				std::cerr << "--aov option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( ( arg == "-w" ) || ( arg == "--weights" ) )
+		{
+            if( i + 1 < argc )
+			{
+				int mode = ::atoi( argv[++i] );
+				if( mode == 0 )
+				{
+					opt.weightMode = Options::kPerChannel;
+				}
+				else if( mode == 1 )
+				{
+					opt.weightMode = Options::kLuminance;
+				}
+				else if( mode == 2 )
+				{
+					opt.weightMode = Options::kMaxChannel;
+				}
+				else
+				{
+					opt.weightMode = Options::kPerChannel;
+					std::cerr << "The weights option must have a value of 0, 1 or 2. Using the default." << std::endl;
+				}
+            }
+			else
+			{
+				std::cerr << "--weights option requires one argument." << std::endl;
+                return 0;
+            }  
+        }
+		else if( ( arg == "--report" ) || ( arg == "--weightReport" ) )
+		{
+			opt.report = true;
+        }
+		else if( arg == "--asyncWrite" )
+		{
+			opt.asyncWrite = true;
         }
 		else if( ( arg == "-b" ) || ( arg == "--blur" ) )
 		{
@@ -222,6 +702,40 @@ bool options( int argc, char* argv[], Options &opt )
 		}
     }
 
+	// The frames loop once the end of the sequence is reached.
+	opt.startFrame = ( ( opt.startFrame % opt.sequenceLength ) + opt.sequenceLength ) % opt.sequenceLength;
+	if( opt.nImages > opt.sequenceLength && opt.generatePath.empty() && !opt.scaling )
+	{
+		std::cerr << "There are only " << opt.sequenceLength << " unique images available per sequence. Be aware that multiple frames will be reused." << std::endl;
+	}
+	if( opt.imageDirectory == "images" && opt.sequenceNumber > 4 && opt.generatePath.empty() )
+	{
+		opt.sequenceNumber = 0;
+		std::cerr << "There are only 5 preset sequences. Selecting sequence 0." << std::endl;
+	}
+	if( opt.chromaScale > 0 && ( opt.progressive || opt.benchmark || opt.scaling ) )
+	{
+		// These filter the RGB sample set directly, so they can't split it into luma and chroma.
+		std::cerr << "--lumaChroma can't be used with --progressive, --deadline, --benchmark or --scaling." << std::endl;
+		return false;
+	}
+	if( !opt.checkpointPath.empty() && ( opt.chromaScale > 0 || opt.progressive || opt.benchmark || opt.scaling || !opt.streamPath.empty() || !opt.generatePath.empty() ) )
+	{
+		// Only a plain denoise of the images saves its tiles, so these runs couldn't be resumed.
+		std::cerr << "--checkpoint can't be used with --lumaChroma, --progressive, --deadline, --benchmark, --scaling, --stream or --generate." << std::endl;
+		return false;
+	}
+	if( opt.watch && ( opt.progressive || opt.benchmark || opt.scaling || !opt.streamPath.empty() || !opt.generatePath.empty() ) )
+	{
+		opt.watch = false;
+		std::cerr << "Only a plain denoise of the images can watch them for changes. --watch is ignored with --progressive, --deadline, --benchmark, --scaling, --stream and --generate." << std::endl;
+	}
+	if( opt.watch && !opt.checkpointPath.empty() )
+	{
+		opt.checkpointPath.clear();
+		std::cerr << "Watching the frames keeps the filter's state in memory. The checkpoint won't be used." << std::endl;
+	}
+
 	if( argc == 1 )
 	{
 		std::cerr << "Please run: \"" << argv[0] << " --help\" for a complete list of the available options." << std::endl;
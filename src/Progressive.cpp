@@ -0,0 +1,177 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdio.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+
+#include "Options.h"
+#include "Image.h"
+#include "Filter.h"
+#include "Progressive.h"
+
+namespace
+{
+
+/// Marks the pixels on the grid with the given stride which aren't on the grid of the coarser stride.
+void strideMask( int width, int height, int stride, int coarserStride, std::vector< unsigned char > &mask )
+{
+	mask.assign( width * height, 0 );
+	for( int y = 0; y < height; y += stride )
+	{
+		for( int x = 0; x < width; x += stride )
+		{
+			mask[ y * width + x ] = coarserStride == 0 || x % coarserStride != 0 || y % coarserStride != 0;
+		}
+	}
+}
+
+/// Fills result from the pixels of the image which lie on the grid with the given stride.
+void fillFromGrid( const Image &image, int stride, Image &result )
+{
+	const int width = image.width(), height = image.height(), channels = image.channels();
+	result.resize( width, height, channels );
+	for( int y = 0; y < height; ++y )
+	{
+		for( int x = 0; x < width; ++x )
+		{
+			const double *in = image.readable( x - x % stride, y - y % stride );
+			double *out = result.writeable( x, y );
+			for( int c = 0; c < channels; ++c )
+			{
+				out[c] = in[c];
+			}
+		}
+	}
+}
+
+double seconds( std::chrono::steady_clock::time_point start )
+{
+	return std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+}
+
+} // namespace
+
+int progressive( const std::vector< const Image* > &frames, const Options &opt, const std::function< bool ( const Image & ) > &publish )
+{
+	if( frames.empty() )
+	{
+		std::cerr << "There are no images to filter." << std::endl;
+		return 1;
+	}
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+	if( opt.deadline > 0. )
+	{
+		deadline = start + std::chrono::duration_cast< std::chrono::steady_clock::duration >( std::chrono::duration< double >( opt.deadline ) );
+	}
+
+	const int coarsestStride = 4;
+	const int width = frames[0]->width(), height = frames[0]->height();
+	std::vector< unsigned char > mask;
+	Image published;
+	int passes = 0;
+
+	// The preview filters the coarsest grid with a small kernel over the first few frames.
+	{
+		const std::vector< const Image* > previewFrames( frames.begin(), frames.begin() + std::min( int( frames.size() ), 3 ) );
+		Options previewOpt = opt;
+		previewOpt.kernelWidth = std::min( opt.kernelWidth, 3 );
+
+		SampleSet set( previewFrames, opt.compactSamples );
+		std::unique_ptr< SampleSet > guide = weightGuideSet( previewFrames, previewOpt );
+		const SampleSet &weights = guide ? *guide : set;
+		SourceTerms terms( weights );
+
+		Image preview( width, height, set.channels() );
+		strideMask( width, height, coarsestStride, 0, mask );
+		FilterControl control;
+		control.mask = &mask;
+		control.showProgress = false;
+		filter( weights, terms, set, previewOpt, preview, control );
+
+		fillFromGrid( preview, coarsestStride, published );
+		if( !publish( published ) )
+		{
+			return 1;
+		}
+		++passes;
+		fprintf( stderr, "Published the preview (%d frames, kernel width %d, pixel stride %d) after %.3fs.\n", int( previewFrames.size() ), previewOpt.kernelWidth, coarsestStride, seconds( start ) );
+	}
+
+	// The refinement passes share one sample set and its source terms, and each
+	// fills in the pixels between the ones that the pass before it filtered.
+	if( std::chrono::steady_clock::now() < deadline )
+	{
+		SampleSet set( frames, opt.compactSamples );
+		std::unique_ptr< SampleSet > guide = weightGuideSet( frames, opt );
+		const SampleSet &weights = guide ? *guide : set;
+		SourceTerms terms( weights );
+
+		Image refined( width, height, set.channels() );
+		for( int stride = coarsestStride, coarser = 0; stride >= 1; coarser = stride, stride /= 2 )
+		{
+			strideMask( width, height, stride, coarser, mask );
+			FilterControl control;
+			control.mask = &mask;
+			control.deadline = deadline;
+			control.showProgress = false;
+			if( !filter( weights, terms, set, opt, refined, control ) )
+			{
+				break;
+			}
+
+			fillFromGrid( refined, stride, published );
+			if( !publish( published ) )
+			{
+				return 1;
+			}
+			++passes;
+			fprintf( stderr, "Published refinement pass %d (%d frames, kernel width %d, pixel stride %d) after %.3fs.\n", passes - 1, int( frames.size() ), opt.kernelWidth, stride, seconds( start ) );
+		}
+	}
+
+	if( passes < 4 )
+	{
+		fprintf( stderr, "The %.3fs deadline passed after %d of 4 passes so the output is the last complete pass.\n", opt.deadline, passes );
+	}
+	else
+	{
+		fprintf( stderr, "Filtered in %gs.\n", seconds( start ) );
+	}
+
+	return 0;
+}
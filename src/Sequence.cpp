@@ -0,0 +1,233 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+
+#include "Options.h"
+#include "Image.h"
+#include "Filter.h"
+#include "Sequence.h"
+
+std::string sequencePath( const std::string &name, const Options &opt, int i )
+{
+	std::stringstream s;
+	s << opt.imageDirectory << "/" << name << opt.sequenceNumber << "." << ( opt.startFrame + i ) % opt.sequenceLength << ".ppm";
+	return s.str();
+}
+
+std::string groundTruthPath( const Options &opt )
+{
+	std::stringstream s;
+	if( opt.imageDirectory != "images" )
+	{
+		s << opt.imageDirectory << "/";
+	}
+	s << "groundTruth";
+	if( opt.sequenceNumber > 0 )
+	{
+		s << opt.sequenceNumber + 1;
+	}
+	s << ".ppm";
+	return s.str();
+}
+
+void proceduralScene( int width, int height, Image &scene )
+{
+	scene.resize( width, height, 3 );
+	for( int y = 0; y < height; ++y )
+	{
+		for( int x = 0; x < width; ++x )
+		{
+			const double fx = ( x + .5 ) / width, fy = ( y + .5 ) / height;
+			const double base = ( int( fx * 8 ) + int( fy * 6 ) ) % 2 ? .65 : .2;
+			const double dx = ( fx - .5 ) * width / height, dy = fy - .5;
+			const double disc = dx * dx + dy * dy < .09 ? .15 : 0.;
+			double *pixel = scene.writeable( x, y );
+			for( int c = 0; c < 3; ++c )
+			{
+				pixel[c] = std::min( base * ( .5 + .5 * fx ) * ( .6 + .2 * c ) + disc * ( 1. + fy ), 1. );
+			}
+		}
+	}
+}
+
+void resizeImage( const Image &image, int width, int height, Image &resized )
+{
+	const int channels = image.channels();
+	resized.resize( width, height, channels );
+	for( int y = 0; y < height; ++y )
+	{
+		const double fy = std::max( ( y + .5 ) * image.height() / height - .5, 0. );
+		const int y0 = int( fy );
+		const double ty = fy - y0;
+		for( int x = 0; x < width; ++x )
+		{
+			const double fx = std::max( ( x + .5 ) * image.width() / width - .5, 0. );
+			const int x0 = int( fx );
+			const double tx = fx - x0;
+
+			// readable() clamps the neighbours at the edges of the image.
+			const double *p00 = image.readable( x0, y0 ), *p10 = image.readable( x0 + 1, y0 );
+			const double *p01 = image.readable( x0, y0 + 1 ), *p11 = image.readable( x0 + 1, y0 + 1 );
+			double *out = resized.writeable( x, y );
+			for( int c = 0; c < channels; ++c )
+			{
+				out[c] = ( p00[c] * ( 1. - tx ) + p10[c] * tx ) * ( 1. - ty ) + ( p01[c] * ( 1. - tx ) + p11[c] * tx ) * ty;
+			}
+		}
+	}
+}
+
+bool generatorScene( const Options &opt, Image &scene )
+{
+	if( opt.generateSource.empty() )
+	{
+		proceduralScene( opt.generateWidth > 0 ? opt.generateWidth : 512, opt.generateHeight > 0 ? opt.generateHeight : 512, scene );
+		return true;
+	}
+
+	Image source;
+	if( !readPPM( opt.generateSource, source ) )
+	{
+		std::cerr << "Failed to open image " << opt.generateSource << std::endl;
+		return false;
+	}
+	if( opt.generateWidth > 0 && ( opt.generateWidth != source.width() || opt.generateHeight != source.height() ) )
+	{
+		resizeImage( source, opt.generateWidth, opt.generateHeight, scene );
+	}
+	else
+	{
+		std::swap( scene, source );
+	}
+	return true;
+}
+
+void noisyFrame( const Image &scene, int frame, const Options &opt, Image &image )
+{
+	const int width = scene.width(), height = scene.height(), channels = scene.channels();
+	const double minValue = gamma22Table()[1];
+	image.resize( width, height, channels );
+
+	// Each row has its own random sequence so that the rows can be shared between threads.
+	std::atomic< int > nextRow( 0 );
+	auto worker = [&]()
+	{
+		for( int y = nextRow++; y < height; y = nextRow++ )
+		{
+			std::seed_seq seeds = { opt.seed, (unsigned int)frame, (unsigned int)y };
+			std::mt19937 random( seeds );
+			std::normal_distribution< double > gaussian( 0., 1. );
+			std::uniform_real_distribution< double > uniform( 0., 1. );
+			for( int x = 0; x < width; ++x )
+			{
+				const double *in = scene.readable( x, y );
+				double *out = image.writeable( x, y );
+				if( uniform( random ) < opt.dropouts )
+				{
+					std::fill( out, out + channels, 0. );
+					continue;
+				}
+				for( int c = 0; c < channels; ++c )
+				{
+					double v = in[c] + gaussian( random ) * opt.noise * sqrt( std::max( in[c], 0. ) );
+					if( uniform( random ) < opt.fireflies )
+					{
+						v = 1.;
+					}
+					out[c] = std::min( std::max( v, minValue ), 1. );
+				}
+			}
+		}
+	};
+
+	std::vector< std::thread > threads;
+	for( int i = 1; i < std::min( filterThreads( opt ), height ); ++i )
+	{
+		threads.push_back( std::thread( worker ) );
+	}
+	worker();
+	for( unsigned int i = 0; i < threads.size(); ++i )
+	{
+		threads[i].join();
+	}
+}
+
+int generateSequence( const Options &opt )
+{
+	Image scene;
+	if( !generatorScene( opt, scene ) )
+	{
+		return 1;
+	}
+
+	if( mkdir( opt.generatePath.c_str(), 0755 ) != 0 && errno != EEXIST )
+	{
+		std::cerr << "Failed to create the directory \"" << opt.generatePath << "\"." << std::endl;
+		return 1;
+	}
+
+	Options layout = opt;
+	layout.imageDirectory = opt.generatePath;
+	layout.startFrame = 0;
+
+	std::cerr << "Generating " << opt.sequenceLength << " frames of " << scene.width() << "x" << scene.height() << " in \"" << opt.generatePath << "\"." << std::endl;
+	if( !writePPM( groundTruthPath( layout ), scene ) )
+	{
+		std::cerr << "Failed to write image " << groundTruthPath( layout ) << std::endl;
+		return 1;
+	}
+
+	// The frames are written one at a time so that long sequences of large frames fit in memory.
+	Image frame;
+	for( int i = 0; i < opt.sequenceLength; ++i )
+	{
+		noisyFrame( scene, i, opt, frame );
+		if( !writePPM( sequencePath( "image", layout, i ), frame ) )
+		{
+			std::cerr << "Failed to write image " << sequencePath( "image", layout, i ) << std::endl;
+			return 1;
+		}
+		fprintf( stderr, "\rGenerated %d of %d frames.", i + 1, opt.sequenceLength );
+	}
+	fprintf( stderr, "\n" );
+
+	return 0;
+}
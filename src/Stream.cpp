@@ -0,0 +1,268 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <chrono>
+#include <memory>
+
+#include "Options.h"
+#include "Image.h"
+#include "Filter.h"
+#include "Stream.h"
+#include "Writer.h"
+
+bool readStreamHeader( FILE *f, StreamHeader &header )
+{
+	char format[4] = { 0 };
+	int bytes = fscanf( f, "TDS %d %d %3s", &header.width, &header.height, format );
+	if( bytes == EOF )
+	{
+		return false;
+	}
+	if( bytes != 3 || header.width < 1 || header.height < 1 )
+	{
+		throw std::runtime_error( "Failed to read the stream header." );
+	}
+
+	if( strcmp( format, "u8" ) == 0 )
+	{
+		header.format = StreamHeader::kByte;
+	}
+	else if( strcmp( format, "f32" ) == 0 )
+	{
+		header.format = StreamHeader::kFloat;
+	}
+	else
+	{
+		throw std::runtime_error( "The stream format must be either \"u8\" or \"f32\"." );
+	}
+
+	// The frames are held in images which index their values with an int, so a frame must fit in one
+	// even as floats. This also keeps frameSize() from overflowing.
+	if( size_t( header.width ) * size_t( header.height ) > size_t( std::numeric_limits< int >::max() ) / ( 3 * sizeof( float ) ) )
+	{
+		throw std::runtime_error( "The stream's frames are too large." );
+	}
+
+	// Consume the single whitespace character that separates the header from the frame data.
+	fgetc( f );
+	return true;
+}
+
+bool writeStreamHeader( FILE *f, const StreamHeader &header )
+{
+	const char *format = header.format == StreamHeader::kFloat ? "f32" : "u8";
+	return fprintf( f, "TDS\n%d %d\n%s\n", header.width, header.height, format ) > 0;
+}
+
+bool readStreamFrame( FILE *f, const StreamHeader &header, std::vector< unsigned char > &buffer, Image &image )
+{
+	buffer.resize( header.frameSize() );
+	size_t bytes = fread( &buffer[0], 1, buffer.size(), f );
+	if( bytes == 0 && feof( f ) )
+	{
+		return false;
+	}
+	if( bytes != buffer.size() )
+	{
+		throw std::runtime_error( "The stream ended part way through a frame." );
+	}
+
+	if( image.width() != header.width || image.height() != header.height )
+	{
+		image.resize( header.width, header.height );
+	}
+
+	double *out = image.writeable( 0, 0 );
+	const int n = header.width * header.height * 3;
+	if( header.format == StreamHeader::kFloat )
+	{
+		const float *in = reinterpret_cast< const float* >( &buffer[0] );
+		for( int i = 0; i < n; ++i )
+		{
+			out[i] = in[i];
+		}
+	}
+	else
+	{
+		const double *table = gamma22Table();
+		for( int i = 0; i < n; ++i )
+		{
+			out[i] = table[ buffer[i] ];
+		}
+	}
+	return true;
+}
+
+bool writeStreamFrame( FILE *f, const StreamHeader &header, const Image &image, std::vector< unsigned char > &buffer )
+{
+	buffer.resize( header.frameSize() );
+
+	const double *in = image.at( 0, 0 );
+	const int n = header.width * header.height * 3;
+	if( header.format == StreamHeader::kFloat )
+	{
+		float *out = reinterpret_cast< float* >( &buffer[0] );
+		for( int i = 0; i < n; ++i )
+		{
+			out[i] = float( in[i] );
+		}
+	}
+	else
+	{
+		for( int y = 0; y < header.height; ++y )
+		{
+			encodeGamma22( image, y, &buffer[ y * header.width * 3 ] );
+		}
+	}
+
+	return fwrite( &buffer[0], 1, buffer.size(), f ) == buffer.size();
+}
+
+int denoiseStream( const Options &opt )
+{
+	FILE *in = opt.streamPath == "-" ? stdin : fopen( opt.streamPath.c_str(), "rb" );
+	if( in == NULL )
+	{
+		std::cerr << "Failed to open the stream \"" << opt.streamPath << "\"." << std::endl;
+		return 1;
+	}
+
+	// A renderer which dies part way through leaves a truncated or malformed stream, which
+	// the readers report by throwing.
+	StreamHeader header;
+	try
+	{
+		if( !readStreamHeader( in, header ) )
+		{
+			std::cerr << "The stream is empty." << std::endl;
+			return 1;
+		}
+	}
+	catch( const std::runtime_error &e )
+	{
+		std::cerr << "Failed to read the stream header: " << e.what() << std::endl;
+		return 1;
+	}
+
+	if( !writeStreamHeader( stdout, header ) )
+	{
+		std::cerr << "Failed to write the stream header." << std::endl;
+		return 1;
+	}
+	fflush( stdout );
+
+	// The frames are held in a ring which is only ever as long as the filter window. Each
+	// frame is decoded straight into the slot of the frame that has just left the window
+	// and the sample set is built from pointers into the ring, so the frames aren't copied
+	// into a second vector of images before their samples are gathered into the set, and
+	// the memory in flight is bounded by the window size.
+	const int window = std::max( opt.nImages, 1 );
+	std::vector< Image > ring( window, Image( header.width, header.height ) );
+	std::vector< const Image* > ordered( window );
+	std::vector< unsigned char > inBuffer;
+
+	// With asynchronous writes a frame is encoded and written while the next one is being
+	// filtered, so the results and output buffers are double buffered.
+	std::vector< Image > results( opt.asyncWrite ? 2 : 1, Image( header.width, header.height ) );
+	std::vector< std::vector< unsigned char > > outBuffers( results.size() );
+	BackgroundWriter writer;
+
+	long received = 0, emitted = 0;
+	bool truncated = false;
+	try
+	{
+		while( readStreamFrame( in, header, inBuffer, ring[ received % window ] ) )
+		{
+			std::chrono::steady_clock::time_point arrived = std::chrono::steady_clock::now();
+			if( ++received < window )
+			{
+				continue;
+			}
+
+			// Order the window from the oldest frame to the newest.
+			for( int i = 0; i < window; ++i )
+			{
+				ordered[i] = &ring[ ( received + i ) % window ];
+			}
+
+			const int slot = emitted % results.size();
+			Image &result = results[slot];
+			denoise( ordered, opt, result );
+
+			std::vector< unsigned char > &outBuffer = outBuffers[slot];
+			writer.submit( [&header, &result, &outBuffer]() { return writeStreamFrame( stdout, header, result, outBuffer ) && fflush( stdout ) == 0; }, opt.asyncWrite );
+			if( !opt.asyncWrite && !writer.wait() )
+			{
+				std::cerr << "Failed to write frame " << emitted << " to the stream." << std::endl;
+				return 1;
+			}
+
+			double latency = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - arrived ).count();
+			std::cerr << ( opt.asyncWrite ? "Queued frame " : "Emitted frame " ) << emitted++ << " (frames " << received - window << "-" << received - 1 << ") in " << latency << "ms." << std::endl;
+		}
+	}
+	catch( const std::runtime_error &e )
+	{
+		std::cerr << "The stream stopped at frame " << received << ": " << e.what() << std::endl;
+		truncated = true;
+	}
+
+	if( !writer.wait() )
+	{
+		std::cerr << "Failed to write the stream." << std::endl;
+		return 1;
+	}
+
+	if( in != stdin )
+	{
+		fclose( in );
+	}
+
+	if( truncated )
+	{
+		return 1;
+	}
+
+	if( received < window )
+	{
+		std::cerr << "The stream ended after " << received << " frames which is fewer than the " << window << " needed to fill the window." << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,264 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "Options.h"
+#include "Image.h"
+#include "Filter.h"
+#include "Sequence.h"
+#include "Tune.h"
+
+namespace
+{
+
+std::string hostName()
+{
+	char name[256] = { 0 };
+	if( gethostname( name, sizeof( name ) - 1 ) != 0 || name[0] == '\0' )
+	{
+		return "localhost";
+	}
+	return name;
+}
+
+int hardwareThreads()
+{
+	return std::max( int( std::thread::hardware_concurrency() ), 1 );
+}
+
+/// Sets the tuned options of opt that weren't set on the command line from tuned.
+void applyTuning( const Options &tuned, Options &opt )
+{
+	if( !( opt.tuneFixed & Options::kTuneThreads ) ) opt.threads = tuned.threads;
+	if( !( opt.tuneFixed & Options::kTuneTileSize ) ) opt.tileSize = tuned.tileSize;
+	if( !( opt.tuneFixed & Options::kTuneKernelVariant ) ) opt.kernelVariant = tuned.kernelVariant;
+}
+
+/// Reads a cached tuning. The cache is ignored if it was written on a host with a
+/// different name or number of hardware threads, for a different number of images
+/// or kernel width, or while a tuned option was held at a value that opt doesn't have.
+bool loadTuning( const std::string &path, Options &opt )
+{
+	std::ifstream file( path.c_str() );
+	if( !file )
+	{
+		return false;
+	}
+
+	std::string key, host;
+	int cores = 0, nImages = -1, kernelWidth = -1, fixed = -1;
+	Options tuned;
+	tuned.threads = tuned.tileSize = tuned.kernelVariant = -1;
+	while( file >> key )
+	{
+		if( key == "host" ) file >> host;
+		else if( key == "cores" ) file >> cores;
+		else if( key == "nImages" ) file >> nImages;
+		else if( key == "kernelWidth" ) file >> kernelWidth;
+		else if( key == "fixed" ) file >> fixed;
+		else if( key == "threads" ) file >> tuned.threads;
+		else if( key == "tileSize" ) file >> tuned.tileSize;
+		else if( key == "kernelVariant" ) file >> tuned.kernelVariant;
+		else file.ignore( std::numeric_limits< std::streamsize >::max(), '\n' );
+	}
+
+	if( host != hostName() || cores != hardwareThreads() || nImages != opt.nImages || kernelWidth != opt.kernelWidth ||
+		tuned.threads < 1 || tuned.tileSize < 0 || ( tuned.kernelVariant != Options::kPixelMajor && tuned.kernelVariant != Options::kChannelMajor ) )
+	{
+		return false;
+	}
+
+	// A tuning which was free to pick an option is also the best for any value of it that opt holds,
+	// as long as that is the value it picked.
+	if( fixed < 0 || ( fixed & ~opt.tuneFixed ) != 0 ||
+		( ( opt.tuneFixed & Options::kTuneThreads ) && tuned.threads != opt.threads ) ||
+		( ( opt.tuneFixed & Options::kTuneTileSize ) && tuned.tileSize != opt.tileSize ) ||
+		( ( opt.tuneFixed & Options::kTuneKernelVariant ) && tuned.kernelVariant != opt.kernelVariant ) )
+	{
+		return false;
+	}
+
+	applyTuning( tuned, opt );
+	return true;
+}
+
+bool saveTuning( const std::string &path, const Options &opt )
+{
+	std::ofstream file( path.c_str() );
+	file << "host " << hostName() << std::endl
+		 << "cores " << hardwareThreads() << std::endl
+		 << "nImages " << opt.nImages << std::endl
+		 << "kernelWidth " << opt.kernelWidth << std::endl
+		 << "fixed " << opt.tuneFixed << std::endl
+		 << "threads " << opt.threads << std::endl
+		 << "tileSize " << opt.tileSize << std::endl
+		 << "kernelVariant " << opt.kernelVariant << std::endl;
+	return bool( file );
+}
+
+/// Builds a small noisy sequence with flat areas, edges and black samples
+/// so that the calibration exercises the same paths as a real render.
+void calibrationSequence( int nImages, std::vector< Image > &images )
+{
+	Options noise;
+	noise.threads = 1;
+	Image scene;
+	proceduralScene( 128, 96, scene );
+
+	images.resize( nImages );
+	for( int i = 0; i < nImages; ++i )
+	{
+		noisyFrame( scene, i, noise, images[i] );
+	}
+}
+
+} // namespace
+
+std::string tuneCachePath( const Options &opt )
+{
+	if( !opt.tuneCachePath.empty() )
+	{
+		return opt.tuneCachePath;
+	}
+
+	const char *home = getenv( "HOME" );
+	std::string directory = home ? std::string( home ) + "/" : std::string( "./" );
+	return directory + ".temporalDenoise." + hostName() + ".tune";
+}
+
+bool autotune( Options &opt )
+{
+	const std::string path = tuneCachePath( opt );
+	if( opt.tune != Options::kTuneForce && loadTuning( path, opt ) )
+	{
+		std::cerr << "Loaded the tuning from \"" << path << "\"." << std::endl;
+		return true;
+	}
+
+	std::cerr << "Tuning the filter for " << hostName() << "..." << std::endl;
+
+	std::vector< Image > images;
+	calibrationSequence( std::min( std::max( opt.nImages, 2 ), 16 ), images );
+	SampleSet set( images );
+	SourceTerms terms( set );
+	Image result;
+
+	// The options that were set on the command line are held at their values.
+	std::vector< int > threadCounts;
+	if( opt.tuneFixed & Options::kTuneThreads )
+	{
+		threadCounts.push_back( opt.threads );
+	}
+	else
+	{
+		threadCounts.push_back( 1 );
+		threadCounts.push_back( hardwareThreads() / 2 );
+		threadCounts.push_back( hardwareThreads() );
+		std::sort( threadCounts.begin(), threadCounts.end() );
+		threadCounts.erase( std::unique( threadCounts.begin(), threadCounts.end() ), threadCounts.end() );
+		threadCounts.erase( std::remove( threadCounts.begin(), threadCounts.end(), 0 ), threadCounts.end() );
+	}
+
+	std::vector< int > tileSizes;
+	if( opt.tuneFixed & Options::kTuneTileSize )
+	{
+		tileSizes.push_back( opt.tileSize );
+	}
+	else
+	{
+		const int sizes[] = { 0, 8, 16, 32, 64 };
+		tileSizes.assign( sizes, sizes + sizeof( sizes ) / sizeof( int ) );
+	}
+
+	std::vector< int > kernelVariants;
+	if( !( opt.tuneFixed & Options::kTuneKernelVariant ) || opt.kernelVariant == Options::kPixelMajor )
+	{
+		kernelVariants.push_back( Options::kPixelMajor );
+	}
+	if( !( opt.tuneFixed & Options::kTuneKernelVariant ) || opt.kernelVariant == Options::kChannelMajor )
+	{
+		kernelVariants.push_back( Options::kChannelMajor );
+	}
+
+	Options candidate = opt, best = opt;
+	double bestTime = std::numeric_limits< double >::max();
+	for( unsigned int t = 0; t < threadCounts.size(); ++t )
+	{
+		for( unsigned int s = 0; s < tileSizes.size(); ++s )
+		{
+			for( unsigned int k = 0; k < kernelVariants.size(); ++k )
+			{
+				candidate.threads = threadCounts[t];
+				candidate.tileSize = tileSizes[s];
+				candidate.kernelVariant = kernelVariants[k];
+
+				// Take the best of two runs to reduce the effect of other processes on the timings.
+				double time = std::numeric_limits< double >::max();
+				for( int run = 0; run < 2; ++run )
+				{
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					filter( set, terms, set, candidate, result, false );
+					time = std::min( time, std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count() );
+				}
+
+				fprintf( stderr, "\tthreads %3d, tile size %3d, kernel variant %d: %8.2fms\n", candidate.threads, candidate.tileSize, candidate.kernelVariant, time );
+				if( time < bestTime )
+				{
+					bestTime = time;
+					best = candidate;
+				}
+			}
+		}
+	}
+
+	applyTuning( best, opt );
+
+	if( !saveTuning( path, opt ) )
+	{
+		std::cerr << "Failed to write the tuning cache \"" << path << "\"." << std::endl;
+	}
+	else
+	{
+		std::cerr << "Saved the tuning to \"" << path << "\"." << std::endl;
+	}
+	return true;
+}
@@ -0,0 +1,82 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2014, Luke Goddard. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining
+//  a copy of this software and associated documentation files (the "Software"),
+//  to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//  and/or sell copies of the Software, and to permit persons to whom
+//  the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included
+//  in all copies or substantial portions of the Software.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <stdexcept>
+
+#include "Writer.h"
+
+namespace
+{
+
+bool runWrite( const std::function< bool () > &write )
+{
+	try
+	{
+		return write();
+	}
+	catch( const std::exception &e )
+	{
+		std::cerr << e.what() << std::endl;
+		return false;
+	}
+}
+
+} // namespace
+
+BackgroundWriter::BackgroundWriter() :
+	m_failed( false )
+{
+}
+
+BackgroundWriter::~BackgroundWriter()
+{
+	wait();
+}
+
+void BackgroundWriter::submit( const std::function< bool () > &write, bool async )
+{
+	wait();
+
+	if( !async )
+	{
+		m_failed = !runWrite( write ) || m_failed;
+		return;
+	}
+
+	m_thread = std::thread( [this, write]() { m_failed = !runWrite( write ) || m_failed; } );
+}
+
+bool BackgroundWriter::wait()
+{
+	if( m_thread.joinable() )
+	{
+		m_thread.join();
+	}
+	return !m_failed;
+}